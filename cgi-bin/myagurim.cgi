@@ -47,6 +47,9 @@ except subprocess.CalledProcessError as e:
 if fs.getfirst('outfmt', 'text') == 'json':
         if isinstance(res, str) and res:
                 res = ast.literal_eval(res)
+        # the results of several criteria come in a list
+        if isinstance(res, list):
+                res = {'results': res}
         res['cmd'] = cmd
 sys.stdout.write(json.dumps(res, indent=1))
 
@@ -34,8 +34,8 @@ new function() {
 	myAgurim = {
 		main: function() {
 			common.type = html.main;
-			myAgurim.sendQuery('packet');
-			myAgurim.sendQuery('byte');
+			// both series in one run
+			myAgurim.sendQuery('byte,packet');
 		},
 		detailMain: function(params) {
 			common.type = html.detail;
@@ -50,6 +50,7 @@ new function() {
 			myAgurim.sendQuery(query.criteria);
 		},
 		sendQuery: function(criteria) {
+			query.criteria = criteria;
 			$.ajax({
 				type: "POST",
 				url: cgi_path + "myagurim.cgi",
@@ -67,12 +68,16 @@ new function() {
 			})
 				.done(function(data) {
 					if (query.outfmt == 'json') {
-						var response, plotdata;
+						var response, plotdata, results;
 						console.log("cmd:" + data['cmd']);
-						response = myAgurim.parseResponse(data);
-						myAgurim.insertTimeLabel(response.startTime, response.endTime, response.interval);
-						plotdata = myAgurim.generatePlotData(response.criteria, response.interval, response.nflows, response.labels, response.data);
-						myAgurim.visualizeStaticPlot(response.id, response.ylabel, plotdata);
+						// a result for each criteria, or a single one
+						results = data['results'] ? data['results'] : [data];
+						for (var i = 0; i < results.length; i++) {
+							response = myAgurim.parseResponse(results[i]);
+							myAgurim.insertTimeLabel(response.startTime, response.endTime, response.interval);
+							plotdata = myAgurim.generatePlotData(response.criteria, response.interval, response.nflows, response.labels, response.data);
+							myAgurim.visualizeStaticPlot(response.id, response.ylabel, plotdata);
+						}
 					}
 					if (query.outfmt == 'text') {
 						var textId = document.getElementById('text');
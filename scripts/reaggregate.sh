@@ -86,13 +86,18 @@ cmd="${agurim} -i ${res} ${files} > ${dstfile}"
 ${verbose} && echo "exec cmd: ${cmd}" 1>&2
 eval "${cmd}"
 
-# if this is 11pm, update monthly and yearly files
+# if this is 11pm, update monthly and yearly files.
+# these long runs take checkpoints, and a run interrupted (e.g., by a
+# reboot) is resumed by the next invocation; the output is opened by
+# ">>" for -r to keep the part written before the checkpoint.  if the
+# inputs have changed since the checkpoint, start over.
 if [ "$hour" = "23" ]; then
     res="7200" # time resolution (2 hours)
     cd "${logdir}/${year}${month}"
     dstfile="${year}${month}.agr"
     files="${year}${month}??/${year}${month}??.agr"
-    cmd="${agurim} -i ${res} ${files} > ${dstfile}"
+    cmd="${agurim} -c ${dstfile}.ckpt -r -i ${res} ${files} >> ${dstfile} || \
+	${agurim} -c ${dstfile}.ckpt -i ${res} ${files} > ${dstfile}"
     ${verbose} && echo "exec cmd: ${cmd}" 1>&2
     eval "${cmd}"
 
@@ -101,7 +106,8 @@ if [ "$hour" = "23" ]; then
     cd "${logdir}"
     dstfile="${year}.agr"
     files="${year}??/${year}??.agr"
-    cmd="${agurim} -i ${res} ${files} > ${dstfile}"
+    cmd="${agurim} -c ${dstfile}.ckpt -r -i ${res} ${files} >> ${dstfile} || \
+	${agurim} -c ${dstfile}.ckpt -i ${res} ${files} > ${dstfile}"
     ${verbose} && echo "exec cmd: ${cmd}" 1>&2
     eval "${cmd}"
 fi
@@ -37,21 +37,30 @@
 #include "agurim_plot.h"
 #include "agurim_odflow.h"
 #include "agurim_hhh.h"
+#include "agurim_window.h"
+#include "agurim_ckpt.h"
+#include "agurim_part.h"
 #include "util/file_string.h"
 
 static void agurim_init(void);
 static void agurim_finish(void);
 static void option_parse(int argc, void *argv);
+static void thresh_parse(char *arg);
+static void basis_parse(char *arg);
 
 static void
 usage()
 {
 	fprintf(stderr, "usage:\n");
-	fprintf(stderr, "  agurim [-dhpP]\n");
+	fprintf(stderr, "  agurim [-dhprIMP]\n");
+	fprintf(stderr, "          [-a engine (reduce/hash/trie/sketch)] [-k counters]\n");
+	fprintf(stderr, "          [-l lattice (fast/exact/auto)]\n");
 	fprintf(stderr, "          [-f '<src> <dst>' or '<proto>:<sport>:<dport>'\n");
-	fprintf(stderr, "          [-m criteria (byte/packet)]\n"); 
+	fprintf(stderr, "          [-m criteria (byte/packet)[,...]]\n"); 
 	fprintf(stderr, "          [-n nflow] [-s duration] \n");
-	fprintf(stderr, "          [-t thresh_percentage]\n");
+	fprintf(stderr, "          [-t thresh_percentage[,...]] [-T nthread]\n");
+	fprintf(stderr, "          [-w nwindow]\n");
+	fprintf(stderr, "          [-c ckptfile] [-C ckpt_period] [-o partfile]\n");
 	fprintf(stderr, "          [-S start_time] [-E end_time]\n");
 	fprintf(stderr, "          files or directories\n");
 	exit(1);
@@ -70,8 +79,17 @@ int main(int argc, char **argv)
 	argv += optind;
 
 	if (argc == 0){
-		/* stdin supports re-aggregation format only. */
-		if (query.outfmt != REAGGREGATION) 
+		/*
+		 * a checkpoint needs the input files to resume, and
+		 * partial aggregates are merged from files.
+		 */
+		if (query.ckpt_file != NULL || query.merge)
+			usage();
+		/*
+		 * stdin supports re-aggregation format only, but for the
+		 * sliding window, which needs no second pass.
+		 */
+		if ((query.outfmt != REAGGREGATION) && (query.window == 0))
 			usage();
 		else
 			read_stdin();
@@ -90,6 +108,19 @@ again:
 		++in;
 		--n;
 	}
+	if (query.part_file != NULL) {
+		/* the last interval of the partial aggregates */
+		part_finish();
+		param_finish();
+		return (0);
+	}
+	if (query.window > 0) {
+		/* the last interval of the stream */
+		if (inparam.total_packet > 0)
+			window_run();
+		param_finish();
+		return (0);
+	}
 	if (inparam.mode == HHH_MAIN_MODE){
 		hhh_run();
 		if (query.outfmt != REAGGREGATION) {
@@ -102,6 +133,7 @@ again:
 		plot_run();
 	}
 	agurim_finish();
+	ckpt_done();
 
 	return (0);
 }
@@ -110,6 +142,8 @@ static void
 agurim_init(void)
 {
 	param_init();
+	ckpt_init();
+	part_init();
 }
 
 static void
@@ -124,8 +158,23 @@ option_parse(int argc, void *argv)
 {
 	int ch;
 
-	while ((ch = getopt(argc, argv, "df:hi:m:n:ps:t:E:PS:")) != -1) {
+	while ((ch = getopt(argc, argv, "a:c:df:hi:k:l:m:n:o:prs:t:w:C:E:IMPS:T:")) != -1) {
 		switch (ch) {
+		case 'a':	/* HHH aggregation engine */
+			if (!strncmp(optarg, "reduce", 6))
+				query.engine = REDUCE_ENGINE;
+			else if (!strncmp(optarg, "hash", 4))
+				query.engine = HASH_ENGINE;
+			else if (!strncmp(optarg, "trie", 4))
+				query.engine = TRIE_ENGINE;
+			else if (!strncmp(optarg, "sketch", 6))
+				query.engine = SKETCH_ENGINE;
+			else
+				usage();
+			break;
+		case 'c':	/* checkpoint file */
+			query.ckpt_file = optarg;
+			break;
 		case 'd':	/* Set the output format = txt */
 			query.outfmt = DEBUG;
 			query.basis = BYTE;
@@ -140,19 +189,32 @@ option_parse(int argc, void *argv)
 		case 'i':
 			query.aggr_interval = strtol(optarg, NULL, 10);
 			break;
-		case 'm':
-			if (!strncmp(optarg, "byte", 4))
-				query.basis = BYTE;
-			else if (!strncmp(optarg, "packet", 6))
-				query.basis = PACKET;
+		case 'k':	/* counters for a label in the sketch engine */
+			if (optarg[0] == '-')
+				usage();
+			query.sketch_size = strtol(optarg, NULL, 10);
+			break;
+		case 'l':	/* HHH label lattice */
+			if (!strncmp(optarg, "fast", 4))
+				query.lattice = LATTICE_FAST;
+			else if (!strncmp(optarg, "exact", 5))
+				query.lattice = LATTICE_EXACT;
+			else if (!strncmp(optarg, "auto", 4))
+				query.lattice = LATTICE_AUTO;
 			else
 				usage();
 			break;
+		case 'm':
+			basis_parse(optarg);
+			break;
 		case 'n':
 			if (optarg[0] == '-')
 				usage();
 			query.nflow = strtol(optarg, NULL, 10);
 			break;
+		case 'o':	/* write partial aggregates (a worker) */
+			query.part_file = optarg;
+			break;
 		case 'p':	/* Set the output format = json */
 			/* If -d and -p are input at the same time, use -d */
 			if (query.outfmt != DEBUG) {
@@ -160,6 +222,9 @@ option_parse(int argc, void *argv)
 				query.basis  = BYTE;
 			}
 			break;
+		case 'r':	/* resume from the checkpoint */
+			query.resume = 1;
+			break;
 		case 's':
 			if (optarg[0] == '-')
 				usage();
@@ -168,13 +233,29 @@ option_parse(int argc, void *argv)
 		case 't':
 			if (optarg[0] == '-')
 				usage();
-			query.threshold = strtod(optarg, NULL);
+			thresh_parse(optarg);
+			break;
+		case 'w':	/* intervals of the sliding window */
+			if (optarg[0] == '-')
+				usage();
+			query.window = strtol(optarg, NULL, 10);
+			break;
+		case 'C':	/* seconds between checkpoints */
+			if (optarg[0] == '-')
+				usage();
+			query.ckpt_period = strtol(optarg, NULL, 10);
 			break;
 		case 'E':
 			if (optarg[0] == '-')
 				usage();
 			query.end_time = strtol(optarg, NULL, 10);
 			break;
+		case 'I':	/* incremental HHH across intervals */
+			query.incremental = 1;
+			break;
+		case 'M':	/* merge partial aggregates (the coordinator) */
+			query.merge = 1;
+			break;
 		case 'P':
 			query.view = PROTO_VIEW;
 			break;
@@ -183,9 +264,82 @@ option_parse(int argc, void *argv)
 				usage();
 			query.start_time = strtol(optarg, NULL, 10);
 			break;
+		case 'T':	/* number of HHH threads */
+			if (optarg[0] == '-')
+				usage();
+			query.nthread = strtol(optarg, NULL, 10);
+			break;
 		default:
 			usage();
 			break;
 		}
 	}
+	/* the sketch summaries cannot subtract an expired interval */
+	if ((query.window > 0) && (query.engine == SKETCH_ENGINE))
+		usage();
+	/*
+	 * checkpoints are taken in the single pass of re-aggregation,
+	 * where the counts in the hashes are the whole state.
+	 */
+	if (query.resume && query.ckpt_file == NULL)
+		usage();
+	if ((query.ckpt_file != NULL) &&
+	    ((query.outfmt != REAGGREGATION) || (query.window > 0) ||
+	    (query.engine == SKETCH_ENGINE)))
+		usage();
+	/* so are the partial aggregates, and only from the hashes */
+	if (((query.part_file != NULL) || query.merge) &&
+	    ((query.outfmt != REAGGREGATION) || (query.window > 0) ||
+	    (query.engine == SKETCH_ENGINE) || (query.ckpt_file != NULL)))
+		usage();
+	if ((query.part_file != NULL) && query.merge)
+		usage();
+	if (query.ckpt_period <= 0)
+		query.ckpt_period = CKPT_PERIOD;
+	/* the sketch summaries count by a single criteria */
+	if ((query.nbasis > 1) && (query.engine == SKETCH_ENGINE))
+		usage();
+}
+
+/* a threshold, or a comma separated list of thresholds to sweep */
+static void
+thresh_parse(char *arg)
+{
+	char *cp = arg, *end;
+
+	query.nthreshold = 0;
+	do {
+		if (query.nthreshold == MAX_NTHRESH)
+			usage();
+		query.thresholds[query.nthreshold++] = strtod(cp, &end);
+		if (end == cp || (*end != ',' && *end != '\0'))
+			usage();
+		cp = end + 1;
+	} while (*end == ',');
+	query.threshold = query.thresholds[0];
+}
+
+/* a criteria, or a comma separated list of the criteria of the results */
+static void
+basis_parse(char *arg)
+{
+	char *cp = arg;
+	size_t len;
+
+	query.nbasis = 0;
+	for (;;) {
+		if (query.nbasis == MAX_NBASIS)
+			usage();
+		len = strcspn(cp, ",");
+		if (len >= 4 && !strncmp(cp, "byte", 4))
+			query.bases[query.nbasis++] = BYTE;
+		else if (len >= 6 && !strncmp(cp, "packet", 6))
+			query.bases[query.nbasis++] = PACKET;
+		else
+			usage();
+		if (cp[len] == '\0')
+			break;
+		cp += len + 1;
+	}
+	query.basis = query.bases[0];
 }
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * checkpoint and resume of a re-aggregation (-c ckptfile [-r]).
+ * at a record boundary, every query.ckpt_period seconds, the flows
+ * counted in the current interval, the totals, the input position
+ * and the output offset are written to the checkpoint file.  -r
+ * continues from the checkpoint: the input files before the position
+ * are skipped, and the output is truncated at the offset.  without a
+ * checkpoint, -r starts over with an empty output, with a warning when
+ * the output is not empty.
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agurim_ckpt.h"
+#include "agurim_param.h"
+#include "agurim_odflow.h"
+#include "util/odflow_hash.h"
+#include "util/odflow_file.h"
+#include "util/file_output.h"
+
+#define CKPT_MAGIC	"AGURIMCK"
+#define CKPT_VERSION	3
+#define NHASH		3
+
+/* the options the counts and the output depend on */
+struct ckpt_header {
+	char magic[8];
+	uint32_t version;
+	int32_t aggr_interval;
+	int32_t view;
+	int32_t engine;
+	int32_t lattice;
+	int32_t thresholds[MAX_NTHRESH];
+	int32_t nthreshold;
+	int32_t bases[MAX_NBASIS];
+	int32_t nbasis;
+	int32_t nflow;
+	int32_t total_duration;
+	int64_t start_time;
+	int64_t end_time;
+	int32_t incremental;
+	int32_t filter_af;
+	struct odflow_spec filter;
+};
+
+static uint64_t nfile;		/* files opened so far */
+static char *cur_file;
+static uint64_t resume_nfile;	/* the file to resume, or 0 */
+static char resume_file[1024];
+static int64_t resume_stat[3];	/* offset, size and mtime of the file */
+static time_t last_ckpt;
+static uint32_t npoll;
+
+static void ckpt_write(FILE *fp);
+static void ckpt_header(struct ckpt_header *phdr);
+static void read_hash(FILE *in, struct odflow_hash *phash);
+static void output_seek(off_t offset);
+static void ckpt_fail(const char *func, const char *what);
+
+/* load the checkpoint to resume from, if any */
+void
+ckpt_init(void)
+{
+	struct ckpt_header hdr, hdr0;
+	struct odflow_hash *hash[NHASH] = { ip_hash, ip6_hash, proto_hash };
+	struct stat st;
+	int64_t t[3], output;
+	uint64_t total[2];
+	uint32_t len;
+	FILE *in;
+	int i;
+
+	last_ckpt = time(NULL);
+	if (!query.resume)
+		return;
+	if ((in = fopen(query.ckpt_file, "r")) == NULL) {
+		/* nothing to resume: start over */
+		if (fstat(fileno(stdout), &st) == 0 && S_ISREG(st.st_mode) &&
+		    st.st_size > 0)
+			fprintf(stderr, "%s: %s: no checkpoint, "
+			    "the output is truncated\n", __func__, query.ckpt_file);
+		output_seek(0);
+		return;
+	}
+
+	ckpt_header(&hdr0);
+	if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+	    memcmp(hdr.magic, hdr0.magic, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != hdr0.version)
+		ckpt_fail(__func__, "not a checkpoint");
+	if (memcmp(&hdr, &hdr0, sizeof(hdr)) != 0)
+		ckpt_fail(__func__, "options differ from the checkpoint");
+	if (fread(&resume_nfile, sizeof(uint64_t), 1, in) != 1 ||
+	    fread(&len, sizeof(uint32_t), 1, in) != 1 ||
+	    len >= sizeof(resume_file) ||
+	    fread(resume_file, 1, len, in) != len ||
+	    fread(resume_stat, sizeof(int64_t), 3, in) != 3 ||
+	    fread(&output, sizeof(int64_t), 1, in) != 1 ||
+	    fread(t, sizeof(int64_t), 3, in) != 3 ||
+	    fread(total, sizeof(uint64_t), 2, in) != 2)
+		ckpt_fail(__func__, "truncated checkpoint");
+	resume_file[len] = '\0';
+	inparam.start_time   = t[0];
+	inparam.cur_time     = t[1];
+	inparam.end_time     = t[2];
+	inparam.total_byte   = total[0];
+	inparam.total_packet = total[1];
+	for (i = 0; i < NHASH; i++)
+		read_hash(in, hash[i]);
+	(void)fclose(in);
+
+	/* the output after the checkpoint is written again */
+	if (output >= 0)
+		output_seek(output);
+}
+
+/*
+ * called for every input file.  returns 1 if the file is before the
+ * checkpoint and to be skipped; the file of the checkpoint is read
+ * from the position of the checkpoint.
+ */
+int
+ckpt_open(char *file, FILE *fp)
+{
+	struct stat st;
+
+	nfile++;
+	cur_file = file;
+	if (resume_nfile == 0)
+		return (0);
+	if (nfile < resume_nfile)
+		return (1);
+	if (strcmp(file, resume_file) != 0 || fstat(fileno(fp), &st) != 0 ||
+	    st.st_size != resume_stat[1] || st.st_mtime != resume_stat[2])
+		ckpt_fail(__func__, "input files differ from the checkpoint");
+	if (fseek(fp, resume_stat[0], SEEK_SET) != 0)
+		ckpt_fail(__func__, "cannot seek the input");
+	resume_nfile = 0;
+	return (0);
+}
+
+/* at a record boundary of the input: take a checkpoint if it is due */
+void
+ckpt_poll(FILE *fp)
+{
+	time_t now;
+
+	if (query.ckpt_file == NULL || (++npoll & 1023) != 0)
+		return;
+	now = time(NULL);
+	if (now - last_ckpt < query.ckpt_period)
+		return;
+	ckpt_write(fp);
+	last_ckpt = now;
+}
+
+/* the re-aggregation has completed */
+void
+ckpt_done(void)
+{
+	if (query.ckpt_file != NULL)
+		(void)unlink(query.ckpt_file);
+}
+
+/* write to a temporary file, and replace the checkpoint at once */
+static void
+ckpt_write(FILE *fp)
+{
+	struct ckpt_header hdr;
+	struct odflow_hash *hash[NHASH] = { ip_hash, ip6_hash, proto_hash };
+	struct stat st;
+	char tmp[1024];
+	int64_t t[3], pos[3], output;
+	uint64_t total[2];
+	uint32_t len;
+	FILE *out;
+	int i;
+
+	if ((pos[0] = ftell(fp)) < 0 || fstat(fileno(fp), &st) != 0)
+		return;		/* not a file */
+	pos[1] = st.st_size;
+	pos[2] = st.st_mtime;
+	out_flush();
+	fflush(stdout);
+	output = ftello(stdout);
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", query.ckpt_file);
+	if ((out = fopen(tmp, "w")) == NULL)
+		ckpt_fail(__func__, "cannot create the checkpoint");
+	ckpt_header(&hdr);
+	len = strlen(cur_file);
+	t[0] = inparam.start_time;
+	t[1] = inparam.cur_time;
+	t[2] = inparam.end_time;
+	total[0] = inparam.total_byte;
+	total[1] = inparam.total_packet;
+	fwrite(&hdr, sizeof(hdr), 1, out);
+	fwrite(&nfile, sizeof(uint64_t), 1, out);
+	fwrite(&len, sizeof(uint32_t), 1, out);
+	fwrite(cur_file, 1, len, out);
+	fwrite(pos, sizeof(int64_t), 3, out);
+	fwrite(&output, sizeof(int64_t), 1, out);
+	fwrite(t, sizeof(int64_t), 3, out);
+	fwrite(total, sizeof(uint64_t), 2, out);
+	for (i = 0; i < NHASH; i++)
+		(void)hash_write(out, hash[i]);
+	if (ferror(out) || fflush(out) != 0 || fsync(fileno(out)) != 0 || fclose(out) != 0 ||
+	    rename(tmp, query.ckpt_file) != 0)
+		ckpt_fail(__func__, "cannot write the checkpoint");
+}
+
+static void
+ckpt_header(struct ckpt_header *phdr)
+{
+	int i;
+
+	memset(phdr, 0, sizeof(*phdr));
+	memcpy(phdr->magic, CKPT_MAGIC, sizeof(phdr->magic));
+	phdr->version = CKPT_VERSION;
+	phdr->aggr_interval = query.aggr_interval;
+	phdr->view = query.view;
+	phdr->engine = query.engine;
+	phdr->lattice = query.lattice;
+	for (i = 0; i < query.nthreshold; i++)
+		phdr->thresholds[i] = query.thresholds[i];
+	phdr->nthreshold = query.nthreshold;
+	for (i = 0; i < query.nbasis; i++)
+		phdr->bases[i] = query.bases[i];
+	phdr->nbasis = query.nbasis;
+	phdr->nflow = query.nflow;
+	phdr->total_duration = query.total_duration;
+	phdr->start_time = query.start_time;
+	phdr->end_time = query.end_time;
+	phdr->incremental = query.incremental;
+	phdr->filter_af = query.inflow.af;
+	phdr->filter = query.inflow.spec;
+}
+
+/* hash_write() has kept the order of the buckets for hash_add() */
+static void
+read_hash(FILE *in, struct odflow_hash *phash)
+{
+	struct odflow *pflow;
+	uint64_t i, nrecord;
+
+	if (hash_nrecord(in, &nrecord) != 0)
+		ckpt_fail(__func__, "truncated checkpoint");
+	for (i = 0; i < nrecord; i++) {
+		if ((pflow = odflow_read(in)) == NULL)
+			ckpt_fail(__func__, "truncated checkpoint");
+		(void)hash_add(phash, pflow);
+	}
+}
+
+/*
+ * the output up to the checkpoint is kept.  the output file has to be
+ * opened without truncation, e.g., by ">>" of the shell.
+ */
+static void
+output_seek(off_t offset)
+{
+	struct stat st;
+
+	if (fstat(fileno(stdout), &st) != 0 || !S_ISREG(st.st_mode))
+		return;
+	if (st.st_size < offset)
+		ckpt_fail(__func__, "the output is shorter than the checkpoint");
+	if (ftruncate(fileno(stdout), offset) != 0 ||
+	    fseeko(stdout, offset, SEEK_SET) != 0)
+		ckpt_fail(__func__, "cannot truncate the output");
+}
+
+static void
+ckpt_fail(const char *func, const char *what)
+{
+	fprintf(stderr, "%s: %s: %s\n", func, query.ckpt_file, what);
+	exit(1);
+}
@@ -44,7 +44,11 @@
 #include "agurim_odflow.h"
 #include "agurim_plot.h"
 #include "agurim_hhh.h"
+#include "agurim_window.h"
+#include "agurim_ckpt.h"
+#include "agurim_part.h"
 #include "util/file_string.h"
+#include "util/hhh_sketch.h"
 
 #define AGURIM_BUFSIZ	(BUFSIZ << 1)
 
@@ -89,7 +93,10 @@ read_file(char *file)
 	FILE *fp;
 
 	if ((fp = fopen(file, "r")) != NULL) {
-		read_in(fp);
+		if (query.merge)
+			part_read(fp);
+		else if (!ckpt_open(file, fp))
+			read_in(fp);
 		(void)fclose(fp);
 	}
 }
@@ -117,20 +124,30 @@ read_in(FILE *fp)
 	agr_flg = 0;
 	exit_flg = 0;
 
-	while (fgets(buf, AGURIM_BUFSIZ, fp)) {
+	for (;;) {
+		/* a record boundary, where a checkpoint can be taken */
+		ckpt_poll(fp);
+		if (fgets(buf, AGURIM_BUFSIZ, fp) == NULL)
+			break;
 		if (is_preamble(buf, &exit_flg, &agr_flg)) {
 			if (exit_flg){
 				break;
 			}
 			if (agr_flg) {
 				agr_flg = 0;
-				if (inparam.mode == AGURIM_PLOT_MODE){
+				if (query.window > 0) {
+					window_run();
+				} else if (inparam.mode == AGURIM_PLOT_MODE){
 					plot_run();
 				} else {
 					if (query.outfmt != REAGGREGATION)
 						break;
-					hhh_run();
-					plot_show();
+					if (query.part_file != NULL) {
+						part_write();
+					} else {
+						hhh_run();
+						plot_show();
+					}
 					param_reset_hhhmode();
 				}
 			}
@@ -153,7 +170,11 @@ read_in(FILE *fp)
 		if ((filter_idx = is_filter(&odflow, odproto, nproto)) < 0)
 			continue;
 
-		if (inparam.mode != AGURIM_PLOT_MODE){
+		if ((inparam.mode != AGURIM_PLOT_MODE) &&
+		    (query.engine == SKETCH_ENGINE)) {
+			/* count in the summaries instead of the hash */
+			sketch_addflow(&odflow, odproto, nproto);
+		} else if (inparam.mode != AGURIM_PLOT_MODE){
 			/* add flow entries as odflows based on primary flow criteria */
 			if (query.view == PROTO_VIEW) {
 				for (i = 0; i < nproto; i++){
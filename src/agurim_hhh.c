@@ -39,76 +39,263 @@
 #include "util/odflow_hash.h"
 #include "util/hhh_task.h"
 #include "util/hhh_util.h"
+#include "util/hhh_reduce.h"
+#include "util/hhh_sched.h"
+#include "util/proto_count.h"
+#include "util/hhh_trie.h"
+#include "util/hhh_sketch.h"
 
+#define AL_INITSIZE	64	/* initial agrflow list size */
+
+static struct hhh_ctx main_ctx;
+static struct hhh_ctx *sub_ctx;		/* a context for each thread */
+static int nsub_ctx;
+
+static void hhh_once(void);
+static void flows_save(struct odflow_list **saved);
+static void flows_restore(struct odflow_list **saved, int last);
+static struct odflow_list *
+hhh_create(struct task_tailq *ptaskq, struct hhh_ctx *pctx, int af);
 static void hhh_main(struct task_tailq *ptaskq);
 static void
 hhh_finish(struct odflow_list **list, uint32_t nlist);
+static void hhh_submain(int worker, uint64_t i, void *arg);
+static void subflow_claim(struct odflow *pagrflow);
+static void subflow_release(struct odflow *pagrflow);
+static void subflow_drop(struct odflow *pagrflow);
+static uint64_t topk_bound(struct odflow_list *plist, uint64_t k);
 static void
-create_subhash(struct odflow_hash *phash, struct odflow *pagrflow);
+create_subhash(struct hhh_ctx *pctx, struct odflow *pagrflow);
+static void ctx_init(struct hhh_ctx *pctx, AGURIM_MODE mode);
 
-void 
+/*
+ * HHH for each threshold of the sweep (-t t1,t2,...).  the flows read
+ * in are set aside and handed again to the HHH of each threshold,
+ * so that the input is read and counted once.  the sketch summaries
+ * are kept until all the thresholds have been extracted.
+ */
+void
 hhh_run(void)
+{
+	struct odflow_list *saved[3] = { NULL, NULL, NULL };
+	int k;
+
+	if ((inparam.nresult > 1) && (query.engine != SKETCH_ENGINE))
+		flows_save(saved);
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		if (saved[0] != NULL)
+			flows_restore(saved, k == inparam.nresult - 1);
+		hhh_once();
+	}
+	param_select_result(0);
+	if (query.engine == SKETCH_ENGINE)
+		sketch_clear();
+}
+
+/* HHH for the threshold of the current result */
+static void 
+hhh_once(void)
 {
 	struct task_tailq taskq;
 	struct odflow_list *list[2];
+	struct odflow *pflow;
 	uint32_t nlist;
+	uint64_t i;
 
 	/* step1: set threshold */
 	param_set_thresh();
+	if (main_ctx.pcount == NULL)
+		ctx_init(&main_ctx, HHH_MAIN_MODE);
+	main_ctx.thresh_byte   = inparam.thresh_byte;
+	main_ctx.thresh_packet = inparam.thresh_packet;
+	main_ctx.agrflow_list  = list_alloc(AL_INITSIZE);
 	
 	/* step2: set HHH internal parameters */
 	TAILQ_INIT(&taskq.task_head);
 	taskq.ntask = 0;
-	if (query.view != PROTO_VIEW) {
+	if (query.engine == SKETCH_ENGINE) {
+		/* the flows have been counted in the summaries */
+		nlist = 0;
+		sketch_hhh(&main_ctx);
+	} else if (query.view != PROTO_VIEW) {
 		nlist = 2;
-		list[0] = taskq_create(&taskq, AF_INET);
-		list[1] = taskq_create(&taskq, AF_INET6);
+		list[0] = hhh_create(&taskq, &main_ctx, AF_INET);
+		list[1] = hhh_create(&taskq, &main_ctx, AF_INET6);
 	} else {
+		/* protocol specs are counted in arrays without tasks */
 		nlist = 1;
-		list[0]= taskq_create(&taskq, AF_LOCAL);
+		list[0]= proto_hhh(&main_ctx, main_ctx.proto_hash);
 	}
 
 	/* step3: HHH (overlap algorithm) */
-	hhh_main(&taskq);
+	if ((query.nthread > 1) && (taskq.ntask > 0))
+		hhh_sched_main(&taskq, query.nthread);
+	else
+		hhh_main(&taskq);
 
-	/* step4: free internal parameters */
+	/* keep the key order for the next interval */
+	if (query.incremental && query.engine == REDUCE_ENGINE &&
+	    query.view != PROTO_VIEW) {
+		reduce_seed_commit(AF_INET, list[0]);
+		reduce_seed_commit(AF_INET6, list[1]);
+	}
+
+	/*
+	 * step4: claim the subflows of the extracted flows.
+	 * the subflow HHH is deferred to hhh_subrun() until the flows
+	 * to display are known.  a flow below the nflow-th largest count
+	 * is never displayed, and its subflows are dropped.
+	 */
+	inparam.topk_bound = topk_bound(main_ctx.agrflow_list, query.nflow);
+	for (i = 0; i < main_ctx.agrflow_list->size; i++) {
+		pflow = main_ctx.agrflow_list->list[i];
+		if (FLOW_COUNT(pflow) >= inparam.topk_bound)
+			subflow_claim(pflow);
+		else
+			subflow_drop(pflow);
+		param_add_agrflow(pflow);
+	}
+	param_set_thresh2();
+	list_free(main_ctx.agrflow_list);
+	main_ctx.agrflow_list = NULL;
+
+	/* step5: free internal parameters */
 	hhh_finish(list, nlist); // TODO
 }
 
-/* NOTE: this function for subflow aggregation */
+/* take the flows out of the main hashes, in the order of the buckets */
+static void
+flows_save(struct odflow_list **saved)
+{
+	struct odflow_hash *hash[3] = { ip_hash, ip6_hash, proto_hash };
+	struct odflow *pflow;
+	int h;
+
+	for (h = 0; h < 3; h++) {
+		saved[h] = list_alloc(max(hash[h]->nrecord, 1));
+		if (saved[h] == NULL) {
+			fprintf(stderr, "%s: malloc failed\n", __func__);
+			exit(1);
+		}
+		while ((pflow = hash_pop(hash[h])) != NULL)
+			list_add(saved[h], pflow);
+	}
+}
+
+/*
+ * put the saved flows back in the main hashes, copied but for the last
+ * threshold.  hash_add() inserts at the head of a bucket, so the flows
+ * are added in the reverse order to keep the order of the buckets.
+ */
+static void
+flows_restore(struct odflow_list **saved, int last)
+{
+	struct odflow_hash *hash[3] = { ip_hash, ip6_hash, proto_hash };
+	struct odflow *pflow;
+	uint64_t i;
+	int h;
+
+	for (h = 0; h < 3; h++) {
+		for (i = saved[h]->size; i > 0; i--) {
+			pflow = saved[h]->list[i - 1];
+			if (!last)
+				pflow = odflow_dup(pflow);
+			(void)hash_add(hash[h], pflow);
+		}
+		if (last) {
+			list_free(saved[h]);
+			saved[h] = NULL;
+		}
+	}
+}
+
+/*
+ * NOTE: subflow aggregation for the first n flows of the list.
+ * the subflows have been claimed by hhh_run() in the order of extraction
+ * so that a subflow taken by a more specific agrflow is not counted
+ * again.  each agrflow runs its own HHH in the context of the worker
+ * thread.  the raw subflows of the other flows are released.
+ */
 void
-hhh_submain(struct odflow *pagrflow)
+hhh_subrun(struct odflow_list *plist, uint64_t n)
+{
+	uint64_t i;
+	int nthread;
+
+	n = min(n, plist->size);
+	for (i = n; i < plist->size; i++)
+		subflow_release(plist->list[i]);
+
+	nthread = max(query.nthread, 1);
+	if (nsub_ctx < nthread) {
+		sub_ctx = realloc(sub_ctx, sizeof(struct hhh_ctx) * nthread);
+		if (sub_ctx == NULL) {
+			fprintf(stderr, "%s: realloc failed\n", __func__);
+			exit(1);
+		}
+		for (i = nsub_ctx; i < nthread; i++)
+			ctx_init(&sub_ctx[i], HHH_SEC_MODE);
+		nsub_ctx = nthread;
+	}
+	for (i = 0; i < nthread; i++) {
+		sub_ctx[i].thresh_byte   = inparam.thresh2_byte;
+		sub_ctx[i].thresh_packet = inparam.thresh2_packet;
+	}
+
+	if ((nthread > 1) && (n > 1))
+		sched_foreach(n, nthread, hhh_submain, plist);
+	else {
+		for (i = 0; i < n; i++)
+			hhh_submain(0, i, plist);
+	}
+}
+
+/* NOTE: this function for subflow aggregation */
+static void
+hhh_submain(int worker, uint64_t i, void *arg)
 {
+	struct odflow_list *plist = arg;
+	struct odflow *pagrflow = plist->list[i];
+	struct hhh_ctx *pctx = &sub_ctx[worker];
 	struct task_tailq taskq;
 	struct odflow_list *list[2];
 	uint32_t nlist;
 
-	/* step1: set agurim internal parameter */
-	param_switch_hhhmode();
+	if (pagrflow->subflow == NULL)
+		return;
 
-	/* step2: set HHH internal parameters */
+	/* step1: set HHH internal parameters */
 	TAILQ_INIT(&taskq.task_head);
 	taskq.ntask = 0;
+	pctx->subflow_list = NULL;
+	create_subhash(pctx, pagrflow);
 	if (query.view != PROTO_VIEW) {
-		create_subhash(proto_hash, pagrflow);
 		nlist = 1;
-		list[0]= taskq_create(&taskq, AF_LOCAL);
+		list[0]= proto_hhh(pctx, pctx->proto_hash);
 	} else {
-		create_subhash(ip_hash, pagrflow);
-		create_subhash(ip6_hash, pagrflow);
 		nlist = 2;
-		list[0] = taskq_create(&taskq, AF_INET);
-		list[1] = taskq_create(&taskq, AF_INET6);
+		list[0] = hhh_create(&taskq, pctx, AF_INET);
+		list[1] = hhh_create(&taskq, pctx, AF_INET6);
 	}
-	param_set_thresh2();
 
-	/* step3: HHH (overlap algorithm) */
+	/* step2: HHH (overlap algorithm) */
 	hhh_main(&taskq);
 
-	/* step4: free agurim internal parameter */
+	/* step3: free HHH internal parameters */
 	hhh_finish(list, nlist);
 
-	param_switch_hhhmode();
+	pagrflow->subflow = pctx->subflow_list;
+	pctx->subflow_list = NULL;
+}
+
+/* the trie engine runs at once without tasks */
+static struct odflow_list *
+hhh_create(struct task_tailq *ptaskq, struct hhh_ctx *pctx, int af)
+{
+	if (query.engine == TRIE_ENGINE)
+		return (trie_hhh(pctx, af));
+	return (taskq_create(ptaskq, pctx, af));
 }
 
 static void
@@ -129,8 +316,13 @@ hhh_main(struct task_tailq *ptaskq)
 		if (ptask->done) {
 			refresh_hh(ptask);
 			done = 1;
+		} else if (prune_hh(ptask)) {
+			done = 1;
 		} else {
-			create_hh(ptask);
+			if (query.engine != HASH_ENGINE)
+				reduce_hh(ptask);
+			else
+				create_hh(ptask);
 			done = find_hh(ptask);
 		}
 		if (done){
@@ -163,31 +355,152 @@ hhh_finish(struct odflow_list **list, uint32_t nlist)
 				list_free(pflow->subflow);
 			odflow_free(pflow);
 		}
+		list_free(list[i]);
 	}
 }
 
+/* take the subflows of the member flows not taken by other agrflows */
 static void
-create_subhash(struct odflow_hash *phash, struct odflow *pagrflow)
+subflow_claim(struct odflow *pagrflow)
 {
-	struct odflow *pflow, *psubflow;
+	struct odflow_list *pclaimed = NULL;
+	struct odflow *pflow;
 	uint64_t i, j;
-	uint32_t is_exist;
 
+	/* the sketch engine gives the subflows with the flow */
+	if (pagrflow->cache == NULL)
+		return;
 	for (i = 0; i < pagrflow->cache->size; i++){
 		pflow = pagrflow->cache->list[i];
-		param_update_total2(pflow->byte, pflow->packet);
-		if (pflow->subflow == NULL){
-			printf("%s subflow is null\n", __func__);
-			while (1);
-		}
-		for (j = 0; j < pflow->subflow->size; j++){
-			psubflow = pflow->subflow->list[j];
-			is_exist = hash_add(phash, psubflow);
-			if (is_exist != 0){
-				odflow_free(psubflow);
-			}
+		if (pflow->subflow == NULL)
+			continue;
+		if (pclaimed == NULL) {
+			pclaimed = pflow->subflow;
+		} else {
+			for (j = 0; j < pflow->subflow->size; j++)
+				list_add(pclaimed, pflow->subflow->list[j]);
+			list_free(pflow->subflow);
 		}
-		list_free(pflow->subflow);
 		pflow->subflow = NULL; 
 	}
+	pagrflow->subflow = pclaimed;
+}
+
+/* free the raw subflows of a flow not to be displayed */
+static void
+subflow_release(struct odflow *pagrflow)
+{
+	uint64_t i;
+
+	if (pagrflow->subflow == NULL)
+		return;
+	for (i = 0; i < pagrflow->subflow->size; i++)
+		odflow_free(pagrflow->subflow->list[i]);
+	list_free(pagrflow->subflow);
+	pagrflow->subflow = NULL;
+}
+
+/* drop the raw subflows of the member flows */
+static void
+subflow_drop(struct odflow *pagrflow)
+{
+	uint64_t i;
+
+	if (pagrflow->cache == NULL) {
+		subflow_release(pagrflow);
+		return;
+	}
+	for (i = 0; i < pagrflow->cache->size; i++)
+		subflow_release(pagrflow->cache->list[i]);
+}
+
+/*
+ * the k-th largest count of the flows, kept in a min-heap of k counts.
+ * 0 if any flow may be displayed: no limit, fewer flows than k, or
+ * the combination basis, whose order is not by a single count.
+ */
+static uint64_t
+topk_bound(struct odflow_list *plist, uint64_t k)
+{
+	uint64_t *heap, bound, c, i, j, n;
+
+	if ((k == 0) || (plist->size <= k) || (query.basis == COMBINATION))
+		return (0);
+	heap = malloc(sizeof(uint64_t) * k);
+	if (heap == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	for (n = 0; n < plist->size; n++) {
+		c = FLOW_COUNT(plist->list[n]);
+		if (n < k) {
+			/* sift up */
+			for (i = n; (i > 0) && (heap[(i - 1) / 2] > c); i = (i - 1) / 2)
+				heap[i] = heap[(i - 1) / 2];
+			heap[i] = c;
+			continue;
+		}
+		if (c <= heap[0])
+			continue;
+		/* replace the smallest and sift down */
+		for (i = 0; (j = i * 2 + 1) < k; i = j) {
+			if ((j + 1 < k) && (heap[j + 1] < heap[j]))
+				j++;
+			if (heap[j] >= c)
+				break;
+			heap[i] = heap[j];
+		}
+		heap[i] = c;
+	}
+	bound = heap[0];
+	free(heap);
+	return (bound);
+}
+
+static void
+create_subhash(struct hhh_ctx *pctx, struct odflow *pagrflow)
+{
+	struct odflow_hash *phash;
+	struct odflow *psubflow;
+	uint64_t j;
+	uint32_t is_exist;
+
+	for (j = 0; j < pagrflow->subflow->size; j++){
+		psubflow = pagrflow->subflow->list[j];
+		if (psubflow->af == AF_INET)
+			phash = pctx->ip_hash;
+		else if (psubflow->af == AF_INET6)
+			phash = pctx->ip6_hash;
+		else
+			phash = pctx->proto_hash;
+		is_exist = hash_add(phash, psubflow);
+		if (is_exist != 0){
+			odflow_free(psubflow);
+		}
+	}
+	list_free(pagrflow->subflow);
+	pagrflow->subflow = NULL; 
+}
+
+/* the main context works on the global hashes filled by read_in() */
+static void
+ctx_init(struct hhh_ctx *pctx, AGURIM_MODE mode)
+{
+	memset(pctx, 0, sizeof(struct hhh_ctx));
+	pctx->mode = mode;
+	if (mode == HHH_MAIN_MODE) {
+		pctx->ip_hash    = ip_hash;
+		pctx->ip6_hash   = ip6_hash;
+		pctx->proto_hash = proto_hash;
+	} else {
+		pctx->ip_hash    = hash_alloc();
+		pctx->ip6_hash   = hash_alloc();
+		pctx->proto_hash = hash_alloc();
+	}
+	pctx->pcount = pcount_alloc();
+	if (pctx->ip_hash == NULL || pctx->ip6_hash == NULL ||
+	    pctx->proto_hash == NULL || pctx->pcount == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
 }
@@ -31,6 +31,25 @@
 #define AGURIM_HHH_H
 
 #include "agurim_odflow.h"
+#include "agurim_param.h"
+
+/*
+ * state of an HHH run.  the main HHH and each subflow HHH have their
+ * own context so that subflow aggregation can run in parallel.
+ */
+struct hhh_ctx {
+	AGURIM_MODE mode;		/* HHH_MAIN_MODE or HHH_SEC_MODE */
+	uint64_t thresh_byte, thresh_packet;
+
+	struct odflow_hash *ip_hash;
+	struct odflow_hash *ip6_hash;
+	struct odflow_hash *proto_hash;
+	struct proto_count *pcount;
+
+	struct odflow_list *agrflow_list;	/* extracted in HHH_MAIN_MODE */
+	struct odflow_list *subflow_list;	/* extracted in HHH_SEC_MODE */
+	struct list_index *index[2];	/* IPv4 and IPv6 lists in HHH */
+};
 
 struct task_tailq {
 	TAILQ_HEAD(taskq, hhh_task) task_head;
@@ -38,6 +57,7 @@ struct task_tailq {
 };
 
 struct hhh_task {
+	struct hhh_ctx *ctx;
 	int *label;
 	uint32_t bytesize; 
 	uint32_t bitsize;
@@ -46,8 +66,14 @@ struct hhh_task {
 
 	struct odflow_list *list;
 	int end;
+	struct list_index *index;	/* NULL in child tasks */
+	struct odflow **member;		/* member flows of the aggregates */
 
 	struct odflow *orig_flow;
+	struct odflow_list *output;	/* extracted flows (parallel HHH) */
+
+	struct reduce_lattice *lattice;	/* sort-and-reduce only */
+	uint32_t level;			/* label index in the lattice */
 
 	uint8_t done;
 
@@ -56,7 +82,6 @@ struct hhh_task {
 };
 
 void hhh_run(void);
-void
-hhh_submain(struct odflow *pagrflow);
+void hhh_subrun(struct odflow_list *plist, uint64_t n);
 
 #endif /* AGURIM_HHH_H */
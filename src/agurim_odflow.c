@@ -42,9 +42,77 @@
 #include "util/odflow_hash.h"
 #include "util/odflow_list.h"
 #include "util/file_string.h"
+#include "util/file_output.h"
 
-static uint8_t prefixmask[8]
-    = { 0x00, 0x80, 0xc0, 0xe0, 0xf0, 0xf8, 0xfc, 0xfe };
+/*
+ * prefixmask[len] is the netmask of a prefix length len (0..128)
+ * laid out as an address, so that a prefix of any length is taken
+ * by ANDing whole words of the address and the mask.
+ */
+#define PM(l, i)	((l) <= 8 * (i) ? 0 : (l) >= 8 * (i) + 8 ? 0xff : \
+			    (uint8_t)(0xff00 >> ((l) - 8 * (i))))
+#define PM_ROW(l)	{ PM(l, 0), PM(l, 1), PM(l, 2), PM(l, 3), \
+			  PM(l, 4), PM(l, 5), PM(l, 6), PM(l, 7), \
+			  PM(l, 8), PM(l, 9), PM(l, 10), PM(l, 11), \
+			  PM(l, 12), PM(l, 13), PM(l, 14), PM(l, 15) }
+#define PM_ROW8(l)	PM_ROW(l), PM_ROW(l + 1), PM_ROW(l + 2), PM_ROW(l + 3), \
+			PM_ROW(l + 4), PM_ROW(l + 5), PM_ROW(l + 6), PM_ROW(l + 7)
+#define PM_ROW64(l)	PM_ROW8(l), PM_ROW8(l + 8), PM_ROW8(l + 16), \
+			PM_ROW8(l + 24), PM_ROW8(l + 32), PM_ROW8(l + 40), \
+			PM_ROW8(l + 48), PM_ROW8(l + 56)
+
+static const uint8_t prefixmask[MAXLEN * 8 + 1][MAXLEN] = {
+	PM_ROW64(0), PM_ROW64(64), PM_ROW(128)
+};
+
+static inline uint64_t
+load64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v);
+}
+
+/* the difference of the first differing byte of two words */
+static inline int
+word_diff(uint64_t a, uint64_t b)
+{
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+	int shift;
+
+	if (a == b)
+		return (0);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	a = __builtin_bswap64(a);
+	b = __builtin_bswap64(b);
+#endif
+	/* the first byte in memory is now the most significant one */
+	shift = __builtin_clzll(a ^ b) & ~7;
+	return ((int)((a << shift) >> 56) - (int)((b << shift) >> 56));
+#else
+	uint8_t *pa = (uint8_t *)&a, *pb = (uint8_t *)&b;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		if (pa[i] != pb[i])
+			return (pa[i] - pb[i]);
+	return (0);
+#endif
+}
+
+/* whether the prefixes of the given length are equal */
+static inline int
+prefix_equal(const uint8_t *r, const uint8_t *r2, uint8_t len)
+{
+	const uint8_t *mask = prefixmask[len];
+
+	if ((load64(r) ^ load64(r2)) & load64(mask))
+		return (0);
+	if (len <= 64)
+		return (1);
+	return (((load64(r + 8) ^ load64(r2 + 8)) & load64(mask + 8)) == 0);
+}
 
 /* NOTE: this API does not allocate flow cache. */
 struct odflow*
@@ -89,9 +157,15 @@ odflow_addcount(struct odflow *pflow)
 void
 subodflow_addcount(struct odflow *pflow, struct odflow *psubflow)
 {
-	struct odflow *_psubflow;
-
-	_psubflow = list_lookup(pflow->subflow, &psubflow->spec);
+	struct odflow *_psubflow = NULL;
+
+	/*
+	 * address subflows (in PROTO_VIEW) can be numerous for a protocol
+	 * spec, so that duplicates are simply appended here and merged
+	 * later by hash_add() in create_subhash().
+	 */
+	if (psubflow->af == AF_LOCAL)
+		_psubflow = list_lookup(pflow->subflow, &psubflow->spec);
 	if (_psubflow == NULL){
 		_psubflow = odflow_alloc();
 		if (_psubflow  != NULL){
@@ -122,6 +196,7 @@ odflow_free(struct odflow* pflow)
 {
 	if (pflow->cache != NULL)
 		list_free(pflow->cache);
+	free(pflow->err);
 	free(pflow);
 }
 
@@ -144,17 +219,59 @@ odflow_copy(struct odflow *dst, struct odflow *src)
 	}
 }
 
+/* free a raw flow with its subflows */
+void
+odflow_release(struct odflow *pflow)
+{
+	uint64_t i;
+
+	if (pflow->subflow != NULL) {
+		for (i = 0; i < pflow->subflow->size; i++)
+			odflow_free(pflow->subflow->list[i]);
+		list_free(pflow->subflow);
+	}
+	odflow_free(pflow);
+}
+
+/* a copy of a raw flow with its own copies of the subflows */
+struct odflow *
+odflow_dup(struct odflow *pflow)
+{
+	struct odflow *_pflow, *psubflow;
+	uint64_t i;
+
+	if ((_pflow = odflow_alloc()) == NULL)
+		goto err;
+	_pflow->spec   = pflow->spec;
+	_pflow->af     = pflow->af;
+	_pflow->byte   = pflow->byte;
+	_pflow->packet = pflow->packet;
+	if (pflow->subflow == NULL)
+		return (_pflow);
+	if ((_pflow->subflow = list_alloc(max(pflow->subflow->size, 1))) == NULL)
+		goto err;
+	for (i = 0; i < pflow->subflow->size; i++) {
+		if ((psubflow = odflow_dup(pflow->subflow->list[i])) == NULL)
+			goto err;
+		list_add(_pflow->subflow, psubflow);
+	}
+	return (_pflow);
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
 void
 odflow_print(struct odflow *pflow)
 {
 	if (pflow->af == AF_INET) {
 		ip_print(pflow->spec.src, pflow->spec.srclen);
-		printf(" ");
+		out_char(' ');
 		ip_print(pflow->spec.dst, pflow->spec.dstlen);
 	} 
 	else if (pflow->af == AF_INET6) {
 		ip6_print(pflow->spec.src, pflow->spec.srclen);
-		printf(" ");
+		out_char(' ');
 		ip6_print(pflow->spec.dst, pflow->spec.dstlen);
 	}
 	else if (pflow->af == AF_LOCAL) {
@@ -172,29 +289,32 @@ odproto_print(struct odflow *pproto)
 	int port;
 
 	if (pproto->spec.src[0] == 0)
-		printf("*:");
+		out_char('*');
 	else
-		printf("%d:", pproto->spec.src[0]);
+		out_u64(pproto->spec.src[0]);
+	out_char(':');
 	port = (pproto->spec.src[1] << 8) + pproto->spec.src[2];
 	if (port != 0) {
-		printf("%d", port);
+		out_u64(port);
 		if (pproto->spec.srclen < 24) {  /* port range */
 			int end = port + (1 << (24 - pproto->spec.srclen)) - 1;
-			printf("-%d", end);
+			out_char('-');
+			out_u64(end);
 		}
 	} else
-		printf("*");
-	printf(":");
+		out_char('*');
+	out_char(':');
 
 	port = (pproto->spec.dst[1] << 8) + pproto->spec.dst[2];
 	if (port != 0)  {
-		printf("%d", port);
+		out_u64(port);
 		if (pproto->spec.dstlen < 24) {  /* port range */
 			int end = port + (1 << (24 - pproto->spec.dstlen)) - 1;
-			printf("-%d", end);
+			out_char('-');
+			out_u64(end);
 		}
 	} else
-		printf("*");
+		out_char('*');
 }
 
 struct odflow_spec
@@ -218,44 +338,45 @@ create_spec(struct odflow_spec *pspec, const int *label, int bytesize)
 void
 prefix_set(uint8_t *r0, uint8_t len, uint8_t *r1, int bytesize)
 {
-	uint8_t bits, bytes = len / 8;
-	uint8_t pad = bytesize - bytes;
-
-	bits = len & 7;
-	if (bits)
-		pad--;
-
-	while (bytes-- != 0)
-		*r1++ = *r0++;
-
-	if (bits != 0)
-		*r1++= *r0 & prefixmask[bits]; 
-
-	while (pad--)
-		*r1++ = 0;
+	const uint8_t *mask = prefixmask[len];
+	uint64_t w[2];
+	int i;
+
+	switch (bytesize) {
+	case 16:	/* IPv6 */
+		w[0] = load64(r0) & load64(mask);
+		w[1] = load64(r0 + 8) & load64(mask + 8);
+		memcpy(r1, w, sizeof(w));
+		break;
+	case 8:		/* IPv4 */
+		w[0] = load64(r0) & load64(mask);
+		memcpy(r1, w, sizeof(w[0]));
+		break;
+	default:
+		for (i = 0; i < bytesize; i++)
+			r1[i] = r0[i] & mask[i];
+		break;
+	}
 }
 
 /* compare prefixes for the given length */
 int
 prefix_comp(uint8_t *r, uint8_t *r2, uint8_t len)
 {
-	uint8_t bytes, bits, mask;
+	const uint8_t *mask = prefixmask[len];
+	uint64_t m, a, b;
 
 	if (len == 0)
 		return (0);
 
-	bytes = len / 8;
-	bits = len & 7;
-
-	while (bytes-- != 0) {
-		if (*r++ != *r2++)
-			return (*--r - *--r2);
-	}
-
-	if ((mask = prefixmask[bits]) == 0)
-		return (0);
+	m = load64(mask);
+	a = load64(r) & m;
+	b = load64(r2) & m;
+	if (a != b || len <= 64)
+		return (word_diff(a, b));
 
-	return ((*r & mask) - (*r2 & mask));
+	m = load64(mask + 8);
+	return (word_diff(load64(r + 8) & m, load64(r2 + 8) & m));
 }
 
 /* this function checks if does s1 includes s0. */
@@ -268,8 +389,8 @@ is_overlapped(struct odflow *p0, struct odflow *p1)
 	if ((p0->spec.srclen > p1->spec.srclen) || (p0->spec.dstlen > p1->spec.dstlen))
 		return (0);
 
-	if (prefix_comp(p0->spec.src, p1->spec.src, p0->spec.srclen) != 0 || 
-	    prefix_comp(p0->spec.dst, p1->spec.dst, p0->spec.dstlen) != 0)
+	if (!prefix_equal(p0->spec.src, p1->spec.src, p0->spec.srclen) ||
+	    !prefix_equal(p0->spec.dst, p1->spec.dst, p0->spec.dstlen))
 		return (0);
 
 	return (1);
@@ -45,6 +45,12 @@ struct odflow_spec {
 	uint8_t dstlen;		/* prefix length of destination ip/proto */
 };
 
+/* error bounds of an estimated count (sketch engine only) */
+struct odflow_err {
+	uint64_t byte;
+	uint64_t packet;
+};
+
 struct odf_tailq {
 	TAILQ_HEAD(odfq, odflow) odfq_head;
 	int nrecord;	/* number of record */
@@ -61,12 +67,16 @@ struct odflow {
 
 	struct odflow_list *subflow;
 	struct odflow_list *cache;
+	struct odflow_err *err;
 
 	TAILQ_ENTRY(odflow) odf_chain; /* for hash table */
 };
 
 struct odflow_hash {
 	struct odf_tailq *tbl;
+	uint32_t *used;	/* buckets having records, to drain in order */
+	uint32_t nused;
+	uint32_t next;	/* the bucket in used[] hash_pop() drains */
 	int nrecord;	/* number of records */
 	uint64_t byte;
 	uint64_t packet;
@@ -83,7 +93,9 @@ struct odflow *odflow_alloc(void);
 struct odflow *odflow_addcount(struct odflow *pflow);
 void odflow_reset(void);
 void odflow_free(struct odflow* pflow);
+void odflow_release(struct odflow *pflow);
 void odflow_copy(struct odflow *dst, struct odflow *src);
+struct odflow *odflow_dup(struct odflow *pflow);
 void odflow_print(struct odflow *pflow);
 void odproto_print(struct odflow *pproto);
 
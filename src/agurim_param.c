@@ -42,6 +42,8 @@
 #include "agurim_param.h"
 #include "util/odflow_hash.h"
 #include "util/odflow_list.h"
+#include "util/hhh_sketch.h"
+#include "util/plot_trie.h"
 
 #define INIT_LIST_SIZE 16
 
@@ -52,6 +54,9 @@ static void query_init(void);
 static void inparam_init(void);
 static int calc_interval(void);
 static void alloc_cntlist(uint64_t nslot);
+static void free_cntlist(void);
+static uint64_t cnt_sum(const uint64_t *cnt, uint64_t n);
+static void results_init(void);
 
 void
 param_init(void)
@@ -59,6 +64,7 @@ param_init(void)
 	query_init();
 
 	inparam_init();
+	results_init();
 
 	ip_hash = hash_alloc();
 	ip6_hash = hash_alloc();
@@ -68,11 +74,14 @@ param_init(void)
 void
 param_finish(void)
 {
-	if ((inparam.agrflow_list != NULL) && (inparam.agrflow_list->size > 0))
-		list_free(inparam.agrflow_list);
+	int k;
 
-	if ((inparam.subflow_list != NULL) && (inparam.subflow_list->size > 0))
-		list_free(inparam.subflow_list);
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		param_reset_agrflow_trie();
+		if ((inparam.agrflow_list != NULL) && (inparam.agrflow_list->size > 0))
+			list_free(inparam.agrflow_list);
+	}
 }
 
 void
@@ -87,40 +96,49 @@ param_set_nextmode(void)
 	/* calculate time resolution */
 	inparam.plot_interval  = calc_interval();
  	ntimeslot = ceil((inparam.end_time - inparam.start_time)/inparam.plot_interval) + 1; 
-	alloc_cntlist(ntimeslot);
+	/* and the slot after the last one, zeroed by param_update_cntlist_index() */
+	alloc_cntlist(ntimeslot + 1);
 	inparam.plot_index = 0;
+	inparam.plot_end_time = inparam.end_time;
 	inparam.start_time = 0;
 	inparam.cur_time = 0;
 	inparam.end_time = 0;
 }
 
+/*
+ * the plot lists for the nslot intervals of the sliding window.
+ * the slot after the last one is zeroed by param_update_cntlist_index().
+ */
 void
-param_switch_hhhmode(void)
+param_set_window(uint64_t nslot)
 {
-	if (inparam.mode == HHH_MAIN_MODE){
-		inparam.mode = HHH_SEC_MODE;
-		inparam.total2_byte   = 0;
-		inparam.total2_packet = 0;
-	} else {
-		inparam.mode = HHH_MAIN_MODE;
-		inparam.total2_byte   = 0;
-		inparam.total2_packet = 0;
-	}
+	free_cntlist();
+	alloc_cntlist(nslot + 1);
+	inparam.plot_index = 0;
 }
 
 void 
 param_reset_hhhmode(void)
 {
+	uint64_t i;
+	int k;
+
 	inparam.total_byte   = 0;
 	inparam.total_packet = 0;
-	inparam.total2_byte   = 0;
-	inparam.total2_packet = 0;
 	inparam.start_time = inparam.end_time;
 	inparam.cur_time   = inparam.start_time;
-	if (inparam.agrflow_list->size > 0){
-		list_free(inparam.agrflow_list);
-		inparam.agrflow_list = list_alloc(INIT_LIST_SIZE);
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		param_reset_agrflow_trie();
+		if (inparam.agrflow_list->size > 0){
+			/* the subflows have been freed by the output */
+			for (i = 0; i < inparam.agrflow_list->size; i++)
+				odflow_free(inparam.agrflow_list->list[i]);
+			list_free(inparam.agrflow_list);
+			inparam.agrflow_list = list_alloc(INIT_LIST_SIZE);
+		}
 	}
+	param_select_result(0);
 }
 
 void 
@@ -130,26 +148,23 @@ param_update_total(uint64_t byte, uint64_t packet)
 	inparam.total_packet += packet;
 }
 
-void
-param_update_total2(uint64_t byte, uint64_t packet)
-{
-	inparam.total2_byte   += byte;
-	inparam.total2_packet += packet;
-}		
-
+/* close the current slot, which started at t */
 void 
-param_update_cntlist_index(void)
+param_update_cntlist_index(time_t t)
 {
-	uint64_t i, n, total_count = 0;
-	/* set total count in this turn */
-	n = inparam.agrflow_list->size;
-	for (i = 0; i < n; i++){
-		total_count += inparam.plots.cnt_list[i][inparam.plot_index];
+	int k;
+
+	/* set total count of each result in this turn */
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		inparam.plots.total_list[inparam.plot_index] =
+		    cnt_sum(&PLOT_COUNT(&inparam.plots, inparam.plot_index, 0),
+		    inparam.plots.ncnt);
 	}
-	inparam.plots.total_list[inparam.plot_index] = total_count;
+	param_select_result(0);
 
 	/* set this timestamp */
-	inparam.plots.time_list[inparam.plot_index] = inparam.start_time;
+	inparam.plots.time_list[inparam.plot_index] = t;
 
 	/* reset next timestamp */
 	inparam.plot_index++;
@@ -166,7 +181,7 @@ param_update_plot_count(uint32_t agrflowlist_index, struct odflow *pflow)
 	else
 		cnt = pflow->byte;
 	//printf("%s: agrflowlist_index=%d, plot_index=%d\n", __func__, agrflowlist_index, inparam.plot_index);
-	inparam.plots.cnt_list[agrflowlist_index][inparam.plot_index] += cnt;
+	PLOT_COUNT(&inparam.plots, inparam.plot_index, agrflowlist_index) += cnt;
 }
 		
 void
@@ -200,12 +215,20 @@ param_set_starttime(time_t t, int *exit_flg, int *agr_flg)
 			*agr_flg = 1;
 		}
 	} else {
-		if (t - inparam.start_time >= inparam.plot_interval){
+		/* the flows after the first pass are in no agrflow */
+		if ((inparam.plot_end_time != 0) && (t >= inparam.plot_end_time)) {
+			*exit_flg = 1;
+			return;
+		}
+		if (inparam.plot_slot_time == 0)
+			inparam.plot_slot_time = t;
+		if (t - inparam.plot_slot_time >= inparam.plot_interval){
 			*agr_flg = 1;
 		}
 	}
 
-	if (query.outfmt == REAGGREGATION)
+	/* the sliding window runs until the end of the stream */
+	if (query.outfmt == REAGGREGATION || query.window > 0)
 		return;
 
 	/* int duration = t - plot_timestamps[time_slot]; */
@@ -240,13 +263,7 @@ param_add_agrflow(struct odflow *pflow)
 #endif
 	if (pflow->cache != NULL)
 		list_free(pflow->cache);
-
-	if (inparam.subflow_list != NULL){
-		/* move all entries as subflows.
-		   Then, allocate subflist space again */
-		pflow->subflow = inparam.subflow_list;
-		inparam.subflow_list = NULL;
-	}
+	pflow->cache = NULL;
 #if 0
 	{
 		if (pflow->subflow != NULL ){
@@ -262,17 +279,51 @@ param_add_agrflow(struct odflow *pflow)
 		}
 	}
 #endif
+	param_reset_agrflow_trie();
 	list_add(inparam.agrflow_list, pflow);
 }
 
+/* agrflow_list has changed, and its trie is built again on demand */
+void
+param_reset_agrflow_trie(void)
+{
+	if (inparam.agrflow_trie == NULL)
+		return;
+	ptrie_free(inparam.agrflow_trie);
+	inparam.agrflow_trie = NULL;
+}
+
+/* make the k-th threshold the current result */
 void
-param_add_subflow(struct odflow *pflow)
+param_select_result(int k)
 {
-	if (inparam.subflow_list == NULL)
-		inparam.subflow_list = list_alloc(1);
-	//if (pflow->cache != NULL)	// FIXME
-	//	list_free(pflow->cache);
-	list_add(inparam.subflow_list, pflow);
+	struct agurim_result *pres;
+
+	if (k == inparam.cur_result)
+		return;
+
+	pres = &inparam.results[inparam.cur_result];
+	pres->agrflow_list   = inparam.agrflow_list;
+	pres->agrflow_trie   = inparam.agrflow_trie;
+	pres->cnt_list       = inparam.plots.cnt_list;
+	pres->ncnt           = inparam.plots.ncnt;
+	pres->total_list     = inparam.plots.total_list;
+	pres->thresh2_byte   = inparam.thresh2_byte;
+	pres->thresh2_packet = inparam.thresh2_packet;
+	pres->topk_bound     = inparam.topk_bound;
+
+	pres = &inparam.results[k];
+	inparam.agrflow_list   = pres->agrflow_list;
+	inparam.agrflow_trie   = pres->agrflow_trie;
+	inparam.plots.cnt_list   = pres->cnt_list;
+	inparam.plots.ncnt       = pres->ncnt;
+	inparam.plots.total_list = pres->total_list;
+	inparam.thresh2_byte   = pres->thresh2_byte;
+	inparam.thresh2_packet = pres->thresh2_packet;
+	inparam.topk_bound     = pres->topk_bound;
+	query.threshold = pres->threshold;
+	query.basis     = pres->basis;
+	inparam.cur_result = k;
 }
 
 static void
@@ -284,13 +335,27 @@ query_init(void)
 		query.aggr_interval = 60;
 	if (!query.outfmt) 
 		query.outfmt = REAGGREGATION;
+	if (!query.sketch_size)
+		query.sketch_size = SK_NENTRY;
 	if (!query.threshold) {
 		if (query.outfmt == REAGGREGATION)
 			query.threshold = 1;
 		else
 			query.threshold = 3; // or query.threshold = 10;
 	}
-	if (!query.nflow && query.outfmt != REAGGREGATION)
+	if (!query.nthreshold) {
+		query.thresholds[0] = query.threshold;
+		query.nthreshold = 1;
+	}
+	/* a single criteria is the one of -m, -p or -d */
+	if (query.nbasis <= 1) {
+		query.bases[0] = query.basis;
+		query.nbasis = 1;
+	}
+	/* nflow is the number of flows to plot, the text output has all */
+	if (query.outfmt == REAGGREGATION)
+		query.nflow = 0;
+	else if (!query.nflow)
 		query.nflow = 7;
 	if (query.outfmt == REAGGREGATION)
 		return;
@@ -317,6 +382,33 @@ inparam_init(void)
 	inparam.agrflow_list = list_alloc(INIT_LIST_SIZE);	// FIXME parameter optimization
 }
 
+/*
+ * a result for each criteria and threshold, the thresholds of a criteria
+ * in a row.  the first one is the current.
+ */
+static void
+results_init(void)
+{
+	int k;
+
+	inparam.nresult = query.nbasis * query.nthreshold;
+	inparam.results = calloc(inparam.nresult, sizeof(struct agurim_result));
+	if (inparam.results == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	for (k = 0; k < inparam.nresult; k++) {
+		inparam.results[k].threshold =
+		    query.thresholds[k % query.nthreshold];
+		inparam.results[k].basis = query.bases[k / query.nthreshold];
+		if (k > 0)
+			inparam.results[k].agrflow_list = list_alloc(INIT_LIST_SIZE);
+	}
+	inparam.cur_result = 0;
+	query.threshold = query.thresholds[0];
+	query.basis     = query.bases[0];
+}
+
 /* compute the appropriate interval from the duration */
 /* note: this api assumes inparam.start_time and inparam.end_time r filled in */
 static int
@@ -374,23 +466,66 @@ calc_interval(void)
 static void
 alloc_cntlist(uint64_t nslot)
 {
-	uint64_t i, n;
+	uint64_t n;
+	int k;
 
 	inparam.plots.size = nslot;
 
-	n = inparam.agrflow_list->size;
-	inparam.plots.cnt_list   = malloc(sizeof(uint64_t) * n);
 	inparam.plots.time_list  = malloc(sizeof(time_t) * nslot);
-	inparam.plots.total_list = malloc(sizeof(uint64_t) * nslot);
 	memset(inparam.plots.time_list, 0, sizeof(time_t) * nslot);
-	memset(inparam.plots.total_list, 0, sizeof(uint64_t) * nslot);
 	assert(inparam.plots.time_list == NULL);
-	assert(inparam.plots.total_list == NULL);
- 
-	for (i = 0; i < n; i++){
-		inparam.plots.cnt_list[i]  = malloc(sizeof(uint64_t) * nslot);
-		memset(inparam.plots.cnt_list[i],   0, sizeof(uint64_t) * nslot);
-		assert(inparam.plots.cntlist[i] == NULL);
+
+	/* the time slots are shared by the results */
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		n = inparam.agrflow_list->size;
+		inparam.plots.cnt_list   = calloc(nslot * n + 1, sizeof(uint64_t));
+		inparam.plots.ncnt = n;
+		inparam.plots.total_list = calloc(nslot, sizeof(uint64_t));
+		if (inparam.plots.cnt_list == NULL || inparam.plots.total_list == NULL) {
+			fprintf(stderr, "%s: malloc failed\n", __func__);
+			exit(1);
+		}
+	}
+	param_select_result(0);
+}
+
+
+static void
+free_cntlist(void)
+{
+	int k;
+
+	free(inparam.plots.time_list);
+	inparam.plots.time_list = NULL;
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		free(inparam.plots.cnt_list);
+		free(inparam.plots.total_list);
+		inparam.plots.cnt_list = NULL;
+		inparam.plots.total_list = NULL;
+		inparam.plots.ncnt = 0;
 	}
+	param_select_result(0);
 }
 
+/*
+ * the sum of the counts of a slot.  the independent partial sums let
+ * the compiler add the contiguous counts in vector registers.
+ */
+static uint64_t
+cnt_sum(const uint64_t *cnt, uint64_t n)
+{
+	uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	uint64_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		s0 += cnt[i];
+		s1 += cnt[i + 1];
+		s2 += cnt[i + 2];
+		s3 += cnt[i + 3];
+	}
+	for (; i < n; i++)
+		s0 += cnt[i];
+	return (s0 + s1 + s2 + s3);
+}
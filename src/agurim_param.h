@@ -55,12 +55,34 @@ typedef enum {
 	PROTO_VIEW
 } AGURIM_VIEW;
 
+typedef enum {
+	REDUCE_ENGINE,	/* derive aggregates from the finer label (default) */
+	HASH_ENGINE,	/* hash the raw flows for every label */
+	TRIE_ENGINE,	/* bit-granular HHH on a 2-D prefix trie */
+	SKETCH_ENGINE	/* approximate HHH in Space-Saving summaries */
+} AGURIM_ENGINE;
+
+typedef enum {
+	LATTICE_FAST,	/* the static label tables (default) */
+	LATTICE_EXACT,	/* every 8 (IPv4) or 16 (IPv6) bit combination */
+	LATTICE_AUTO	/* LATTICE_EXACT without the labels covering no flow */
+} AGURIM_LATTICE;
+
+struct plot_trie;
+
+#define MAX_NTHRESH	8	/* thresholds in a sweep (-t t1,t2,...) */
+#define MAX_NBASIS	2	/* criteria of the results (-m byte,packet) */
+
 struct agurim_query {
 	AGGR_BASIS    basis;
 	AGURIM_FORMAT outfmt;
 
 	int aggr_interval;
-	int threshold;
+	int threshold;		/* the threshold of the current result */
+	int thresholds[MAX_NTHRESH];
+	int nthreshold;
+	AGGR_BASIS bases[MAX_NBASIS];	/* the criteria of the results */
+	int nbasis;
 	int nflow;
 	int total_duration;
 	time_t start_time;
@@ -68,16 +90,52 @@ struct agurim_query {
 
 	/* options */
 	AGURIM_VIEW   view;
+	AGURIM_ENGINE engine;
+	AGURIM_LATTICE lattice;
+	int nthread;
+	int sketch_size;	/* counters for a label in SKETCH_ENGINE */
+	int incremental;	/* seed REDUCE_ENGINE with the last interval */
+	int window;		/* intervals of the sliding window, or 0 */
+	char *ckpt_file;	/* checkpoint of a re-aggregation, or NULL */
+	int ckpt_period;	/* seconds between checkpoints */
+	int resume;		/* resume from ckpt_file */
+	char *part_file;	/* partial aggregates of a worker, or NULL */
+	int merge;		/* the input files are partial aggregates */
 	struct odflow inflow; /* filtering odflow */
 };
 
+/*
+ * cnt_list is a matrix of size slots by ncnt agrflows, in one block.
+ * the counts of a slot are contiguous, in the order of agrflow_list.
+ */
 struct plot_list {
  	time_t 	 *time_list;
  	time_t 	 *total_list;
- 	uint64_t **cnt_list;
+ 	uint64_t *cnt_list;
+ 	uint64_t ncnt;		/* agrflows of a slot in cnt_list */
  	uint64_t size;
 };
 
+/* the count of the i-th agrflow in the slot */
+#define PLOT_COUNT(pplots, slot, i) \
+	((pplots)->cnt_list[(slot) * (pplots)->ncnt + (i)])
+
+/*
+ * the result of a threshold and a criteria.  the fields of the current
+ * result are kept in agurim_param, and param_select_result() swaps them.
+ */
+struct agurim_result {
+	int threshold;
+	AGGR_BASIS basis;
+	struct odflow_list *agrflow_list;
+	struct plot_trie *agrflow_trie;
+	uint64_t *cnt_list;
+	uint64_t ncnt;
+	time_t *total_list;
+	uint64_t thresh2_byte, thresh2_packet;
+	uint64_t topk_bound;
+};
+
 struct agurim_param {
 	/* agurim paramters */
 	AGURIM_MODE mode;
@@ -90,17 +148,28 @@ struct agurim_param {
 	int plot_interval; /* time resolution in plots */
 	struct plot_list plots;	/* this structure is used for data in time resultion */
 	uint64_t plot_index;		/* indicate the index of the list in plot_list */
+	time_t plot_slot_time;		/* the start of the current slot */
+	time_t plot_end_time;		/* the end of the aggregated flows */
 
 	/* HHH internal paramters */
 	struct odflow_list *agrflow_list;
-	struct odflow_list *subflow_list;
+	struct plot_trie *agrflow_trie;	/* agrflow_list for the lookups */
 	uint64_t total_byte, total_packet;
-	uint64_t total2_byte, total2_packet;
 	uint64_t thresh_byte, thresh_packet; 
 	uint64_t thresh2_byte,  thresh2_packet; 
+	uint64_t topk_bound;	/* the nflow-th largest count, or 0 */
+
+	/* the results of the thresholds */
+	struct agurim_result *results;
+	int nresult;
+	int cur_result;
 };
 
 #define max(a, b)	(((a)>(b))?(a):(b))
+#define min(a, b)	(((a)<(b))?(a):(b))
+
+/* the count of a flow by the criteria (BYTE or PACKET) */
+#define FLOW_COUNT(p)	((query.basis == PACKET) ? (p)->packet : (p)->byte)
 
 extern struct agurim_query query;
 extern struct agurim_param inparam;
@@ -112,17 +181,17 @@ void param_init(void);
 void param_finish(void);
 
 void param_set_nextmode(void);
-void param_switch_hhhmode(void);
 void param_reset_hhhmode(void);
 void param_update_total(uint64_t byte, uint64_t packet);
-void param_update_total2(uint64_t byte, uint64_t packet);
 void param_set_thresh(void);
 void param_set_thresh2(void);
-void param_update_cntlist_index(void);
+void param_update_cntlist_index(time_t t);
 void param_update_plot_count(uint32_t agrflowlist_index, struct odflow *pflow);
 void param_set_starttime(time_t t, int *exit_flg, int *agr_flg);
 void param_set_endtime(time_t t);
 void param_add_agrflow(struct odflow *pflow);
-void param_add_subflow(struct odflow *pflow);
+void param_select_result(int k);
+void param_reset_agrflow_trie(void);
+void param_set_window(uint64_t nslot);
 
 #endif /* AGURIM_PARAM_H */
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * partial aggregates for a sharded re-aggregation.
+ * a worker (-o partfile) writes the flows counted in each interval,
+ * before HHH, instead of the re-aggregation.  the coordinator (-M)
+ * reads the partial files of the workers in time order, adds the
+ * flows by odflow_addcount(), and runs HHH once for its intervals,
+ * as if it read the input files of all the workers.
+ *
+ * a partial file is a header, followed by the intervals:
+ *	int64_t  the first StartTime and the EndTime of the interval
+ *	uint64_t total bytes and packets
+ *	the records of ip_hash, ip6_hash and proto_hash (hash_write())
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "agurim_part.h"
+#include "agurim_param.h"
+#include "agurim_odflow.h"
+#include "agurim_plot.h"
+#include "agurim_hhh.h"
+#include "util/odflow_hash.h"
+#include "util/odflow_file.h"
+
+#define PART_MAGIC	"AGURIMPT"
+#define PART_VERSION	2
+#define NHASH		3
+
+struct part_header {
+	char magic[8];
+	uint32_t version;
+	int32_t aggr_interval;
+	int32_t view;
+	int32_t filter_af;
+	struct odflow_spec filter;
+};
+
+static FILE *part_fp;
+static time_t first_time;	/* the StartTime opening the next interval */
+
+static void part_header(struct part_header *phdr);
+static void merge_hash(FILE *fp, int merge);
+static void part_fail(const char *func, const char *what);
+
+/* open the partial file of a worker */
+void
+part_init(void)
+{
+	struct part_header hdr;
+
+	if (query.part_file == NULL)
+		return;
+	if ((part_fp = fopen(query.part_file, "w")) == NULL)
+		part_fail(__func__, "cannot create");
+	part_header(&hdr);
+	fwrite(&hdr, sizeof(hdr), 1, part_fp);
+}
+
+/*
+ * write the flows of the interval, and drain the hashes as hhh_run()
+ * does.  called at the end of an interval instead of hhh_run().
+ */
+void
+part_write(void)
+{
+	struct odflow_hash *hash[NHASH] = { ip_hash, ip6_hash, proto_hash };
+	struct odflow *pflow;
+	int64_t t[2];
+	uint64_t total[2];
+	int i;
+
+	t[0] = (first_time != 0) ? first_time : inparam.start_time;
+	t[1] = inparam.end_time;
+	total[0] = inparam.total_byte;
+	total[1] = inparam.total_packet;
+	fwrite(t, sizeof(int64_t), 2, part_fp);
+	fwrite(total, sizeof(uint64_t), 2, part_fp);
+	for (i = 0; i < NHASH; i++) {
+		(void)hash_write(part_fp, hash[i]);
+		while ((pflow = hash_pop(hash[i])) != NULL)
+			odflow_release(pflow);
+	}
+	if (ferror(part_fp))
+		part_fail(__func__, "write failed");
+	/* param_set_starttime() has set the StartTime of the next one */
+	first_time = inparam.cur_time;
+}
+
+/* write the last interval, and close the partial file */
+void
+part_finish(void)
+{
+	if (inparam.start_time != 0)
+		part_write();
+	if (fclose(part_fp) != 0)
+		part_fail(__func__, "write failed");
+	part_fp = NULL;
+}
+
+/* the coordinator: add the intervals of a partial file */
+void
+part_read(FILE *fp)
+{
+	struct part_header hdr, hdr0;
+	int exit_flg = 0, agr_flg = 0;
+	int64_t t[2];
+	uint64_t total[2];
+	int i;
+
+	part_header(&hdr0);
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr.magic, hdr0.magic, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != hdr0.version) {
+		fprintf(stderr, "%s: not a partial aggregate\n", __func__);
+		exit(1);
+	}
+	/* the intervals of the workers have to fit in the intervals */
+	if (hdr.view != hdr0.view || hdr.filter_af != hdr0.filter_af ||
+	    memcmp(&hdr.filter, &hdr0.filter, sizeof(hdr.filter)) != 0 ||
+	    hdr.aggr_interval <= 0 ||
+	    query.aggr_interval % hdr.aggr_interval != 0) {
+		fprintf(stderr, "%s: options differ from the partial aggregate\n",
+		    __func__);
+		exit(1);
+	}
+
+	while (fread(t, sizeof(int64_t), 2, fp) == 2) {
+		if (fread(total, sizeof(uint64_t), 2, fp) != 2)
+			break;
+		/* as read_in() does at a StartTime */
+		param_set_starttime(t[0], &exit_flg, &agr_flg);
+		if (agr_flg) {
+			agr_flg = 0;
+			hhh_run();
+			plot_show();
+			param_reset_hhhmode();
+		}
+		/* before the start time, the flows are skipped */
+		for (i = 0; i < NHASH; i++)
+			merge_hash(fp, inparam.start_time != 0);
+		if (inparam.start_time != 0)
+			param_update_total(total[0], total[1]);
+		param_set_endtime(t[1]);
+	}
+	if (!feof(fp)) {
+		fprintf(stderr, "%s: truncated partial aggregate\n", __func__);
+		exit(1);
+	}
+}
+
+static void
+part_header(struct part_header *phdr)
+{
+	memset(phdr, 0, sizeof(*phdr));
+	memcpy(phdr->magic, PART_MAGIC, sizeof(phdr->magic));
+	phdr->version = PART_VERSION;
+	phdr->aggr_interval = query.aggr_interval;
+	phdr->view = query.view;
+	phdr->filter_af = query.inflow.af;
+	phdr->filter = query.inflow.spec;
+}
+
+/*
+ * add the records of a hash.  the flows and their subflows are added
+ * as read_in() adds the input, so that the order of the buckets and
+ * of the subflows is the same as reading the input files.
+ */
+static void
+merge_hash(FILE *fp, int merge)
+{
+	struct odflow *pflow, *_pflow;
+	uint64_t i, j, nrecord;
+
+	if (hash_nrecord(fp, &nrecord) != 0)
+		goto truncated;
+	for (i = 0; i < nrecord; i++) {
+		if ((pflow = odflow_read(fp)) == NULL)
+			goto truncated;
+		if (merge) {
+			_pflow = odflow_addcount(pflow);
+			for (j = 0; pflow->subflow != NULL &&
+			    j < pflow->subflow->size; j++)
+				subodflow_addcount(_pflow,
+				    pflow->subflow->list[j]);
+		}
+		odflow_release(pflow);
+	}
+	return;
+truncated:
+	fprintf(stderr, "%s: truncated partial aggregate\n", __func__);
+	exit(1);
+}
+
+static void
+part_fail(const char *func, const char *what)
+{
+	fprintf(stderr, "%s: %s: %s\n", func, query.part_file, what);
+	exit(1);
+}
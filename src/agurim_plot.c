@@ -33,24 +33,62 @@
 #include <assert.h>
 
 #include "agurim_plot.h"
+#include "agurim_hhh.h"
 #include "agurim_param.h"
 #include "util/plot_aguri.h"
 #include "util/plot_csv.h"
 #include "util/plot_json.h"
 #include "util/odflow_hash.h"
+#include "util/odflow_list.h"
+#include "util/plot_trie.h"
+#include "util/hhh_sched.h"
+#include "util/file_output.h"
 
-static int
-plot_comp(const void *p0, const void *p1);
-static int
-comp_frac(struct odflow *pflow0, struct odflow *pflow1);
+#define PLOT_CHUNK	4096	/* flows of a slot mapped by a job */
+#define INIT_SLOT_SIZE	1024
+
+/* the flows of a slot mapped on the workers */
+struct plot_map {
+	struct odflow **flows;
+	uint64_t nflow;
+	uint64_t *cnt;		/* the partial counts of the workers */
+	uint64_t ncnt;		/* counts of a worker, of all the results */
+	uint64_t *offset;	/* the counts of a result in those of a worker */
+	struct odflow_list **lists;	/* the agrflows of the results */
+	struct plot_trie **tries;
+};
+
+/* a flow and its key in the order of the output */
+struct plot_key {
+	uint64_t key;
+	uint64_t index;		/* the position in the list, first on a tie */
+	struct odflow *pflow;
+};
+
+static uint64_t flow_key(struct odflow *pflow);
+static int key_before(struct plot_key *pkey0, struct plot_key *pkey1);
+static int key_comp(const void *p0, const void *p1);
+static void sort_flows(struct odflow_list *plist, uint64_t n);
 static void
-add_timeslot(struct odflow_hash *phash);
+add_timeslot(struct odflow_hash *phash, struct odflow_list *pslot);
 static int
 find_overlapped_agrflow(struct odflow *pflow);
+static int
+agrflow_lookup(struct odflow_list *plist, struct plot_trie *ptrie,
+    struct odflow *pflow);
+static int count_results(struct odflow *pflow);
+static void map_flows(struct odflow **flows, uint64_t n);
+static void map_main(int worker, uint64_t i, void *arg);
+static void show_result(void);
 
 void
 plot_addcount(struct odflow* pflow)
 {
+	/* the sketch engine keeps no flow: count the record at once */
+	if (query.engine == SKETCH_ENGINE) {
+		(void)count_results(pflow);
+		return;
+	}
 	(void)odflow_addcount(pflow);
 }
 
@@ -58,40 +96,96 @@ void
 plot_run(void)
 {
 	struct odflow_hash *phash;
+	struct odflow_list *pslot;
+	uint64_t i;
 
+	/* the flows of the slot, mapped to the agrflows at once */
+	if ((pslot = list_alloc(INIT_SLOT_SIZE)) == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
 	if (query.view == PROTO_VIEW){
 		phash = proto_hash;
-		add_timeslot(phash);
+		add_timeslot(phash, pslot);
 	} else {
 		phash = ip_hash;
-		add_timeslot(phash);
+		add_timeslot(phash, pslot);
 		phash = ip6_hash;
-		add_timeslot(phash);
+		add_timeslot(phash, pslot);
 	}
-	param_update_cntlist_index();
+	map_flows(pslot->list, pslot->size);
+	for (i = 0; i < pslot->size; i++)
+		odflow_free(pslot->list[i]);
+	list_free(pslot);
+	param_update_cntlist_index(inparam.plot_slot_time);
+	/* the next slot starts at the interval which closed this one */
+	inparam.plot_slot_time = inparam.cur_time;
 }
 
+/* show the result of each threshold, as a JSON array for a sweep */
 void
 plot_show(void)
 {
-	uint64_t i;
+	int k;
+
+	if ((query.outfmt == JSON) && (inparam.nresult > 1))
+		out_str("[\n");
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		if ((query.outfmt == JSON) && (k > 0))
+			out_str(",\n");
+		show_result();
+	}
+	param_select_result(0);
+	if ((query.outfmt == JSON) && (inparam.nresult > 1))
+		out_str("]\n");
+	/* the checkpoints and the window take the output of an interval */
+	out_flush();
+}
+
+static void
+show_result(void)
+{
+	uint64_t i, n;
 	struct odflow_list *psubflow_list;
 	struct odflow *pflow;
 
+	/* the list is filtered and sorted for the output */
+	param_reset_agrflow_trie();
+
 	// set current index before shaffling the flow list 
         for (i = 0; i < inparam.agrflow_list->size; i++) {
 		pflow = inparam.agrflow_list->list[i];
 		pflow->list_index = i;
 	}
 
-        /* sort flow entries based on the byte/packet count in order */
-        qsort(inparam.agrflow_list->list, inparam.agrflow_list->size, sizeof(struct odflow *), plot_comp);
+	/* the flows below the nflow-th largest count are not displayed */
+	if (inparam.topk_bound > 0) {
+		for (i = 0, n = 0; i < inparam.agrflow_list->size; i++) {
+			pflow = inparam.agrflow_list->list[i];
+			if (FLOW_COUNT(pflow) >= inparam.topk_bound)
+				inparam.agrflow_list->list[n++] = pflow;
+			else
+				odflow_free(pflow);
+		}
+		inparam.agrflow_list->size = n;
+	}
+
+	/* only the top nflow entries are displayed, sorted by the count */
+	n = inparam.agrflow_list->size;
+	if (query.nflow > 0)
+		n = min(n, query.nflow);
+	sort_flows(inparam.agrflow_list, n);
+	hhh_subrun(inparam.agrflow_list, n);
+	for (i = n; i < inparam.agrflow_list->size; i++)
+		odflow_free(inparam.agrflow_list->list[i]);
+	inparam.agrflow_list->size = n;
 
         /* sort subflow entries based on the byte/packet count in order */
         for (i = 0; i < inparam.agrflow_list->size; i++) {
 		psubflow_list = inparam.agrflow_list->list[i]->subflow;
 		if ((psubflow_list != NULL) && (psubflow_list->size > 0))
-        		qsort(psubflow_list->list, psubflow_list->size, sizeof(struct odflow *), plot_comp);
+			sort_flows(psubflow_list, psubflow_list->size);
 	}
 
 	switch (query.outfmt) {
@@ -107,102 +201,281 @@ plot_show(void)
 	}
 }
 
-/* helper for qsort: compare the counters by the given criteria */
-static int
-plot_comp(const void *p0, const void *p1)
-{
-	struct odflow *pflow0, *pflow1;
-	int ret = 0;
+#define KEY_SHARE	((double)(1ULL << 52))	/* a whole share of a key */
 
-	pflow0 = *(struct odflow **)p0;
-	pflow1 = *(struct odflow **)p1;
+/*
+ * the key of a flow in the order of the output, the larger the first.
+ * the combination basis takes the larger share of the byte and packet
+ * counts, in a fixed point.
+ */
+static uint64_t
+flow_key(struct odflow *pflow)
+{
+	uint64_t fbyte = 0, fpacket = 0;
 
 	switch (query.basis) {
 	case BYTE:
-		if (pflow0->byte > pflow1->byte)
-			ret = -1;
-		else if (pflow0->byte < pflow1->byte)
-			ret = 1;
-		break;
+		return (pflow->byte);
 	case PACKET:
-		if (pflow0->packet > pflow1->packet)
-			ret = -1;
-		else if (pflow0->packet < pflow1->packet)
-			ret = 1;
-		break;
+		return (pflow->packet);
 	case COMBINATION:
-		ret = comp_frac(pflow0, pflow1);
 		break;
 	}
-	return (ret);
+	if (inparam.total_byte > 0)
+		fbyte = (double)pflow->byte / inparam.total_byte * KEY_SHARE;
+	if (inparam.total_packet > 0)
+		fpacket = (double)pflow->packet / inparam.total_packet * KEY_SHARE;
+	return (max(fbyte, fpacket));
 }
 
+/* whether the flow of pkey0 is output before that of pkey1 */
+static inline int
+key_before(struct plot_key *pkey0, struct plot_key *pkey1)
+{
+	if (pkey0->key != pkey1->key)
+		return (pkey0->key > pkey1->key);
+	return (pkey0->index < pkey1->index);
+}
+
+/* helper for qsort: the order of the output */
 static int
-comp_frac(struct odflow *pflow0, struct odflow *pflow1)
+key_comp(const void *p0, const void *p1)
 {
-	double fbyte0, fbyte1;
-	double fpacket0, fpacket1;
-	double fv0, fv1;
-
-	fbyte0 = pflow0->byte * 100 / inparam.total_byte;
-	fbyte1 = pflow1->packet * 100 / inparam.total_packet;
-	fpacket0 = pflow0->byte * 100 / inparam.total_byte;
-	fpacket1 = pflow1->packet * 100 / inparam.total_packet;
-
-	fv0 = max(fbyte0, fpacket0);
-	fv1 = max(fbyte1, fpacket1);
-	if (fv0 > fv1)
-		return -1;
-	else if (fv0 < fv1)
-		return 1;
-	return 0;
+	struct plot_key *pkey0 = (struct plot_key *)p0;
+	struct plot_key *pkey1 = (struct plot_key *)p1;
+
+	return (key_before(pkey0, pkey1) ? -1 : 1);
 }
 
+/*
+ * put the first n flows of the list in the order of the output at
+ * its head, and the others after them in no order.  the keys are
+ * computed once, and the first n flows are kept in a heap with the
+ * last of them on the top, so that only those are sorted.
+ */
 static void
-add_timeslot(struct odflow_hash *phash)
+sort_flows(struct odflow_list *plist, uint64_t n)
+{
+	struct plot_key *keys, key;
+	struct odflow **rest;
+	uint64_t i, j, m, nrest = 0;
+
+	if (plist->size <= 1)
+		return;
+	keys = malloc(sizeof(struct plot_key) * plist->size);
+	rest = malloc(sizeof(struct odflow *) * plist->size);
+	if (keys == NULL || rest == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	if (n >= plist->size) {
+		n = plist->size;
+		for (m = 0; m < n; m++) {
+			keys[m].key   = flow_key(plist->list[m]);
+			keys[m].index = m;
+			keys[m].pflow = plist->list[m];
+		}
+	} else if (n > 0) {
+		for (m = 0; m < plist->size; m++) {
+			key.key   = flow_key(plist->list[m]);
+			key.index = m;
+			key.pflow = plist->list[m];
+			if (m < n) {
+				/* sift up */
+				for (i = m; (i > 0) &&
+				    key_before(&keys[(i - 1) / 2], &key);
+				    i = (i - 1) / 2)
+					keys[i] = keys[(i - 1) / 2];
+				keys[i] = key;
+				continue;
+			}
+			if (!key_before(&key, &keys[0])) {
+				rest[nrest++] = key.pflow;
+				continue;
+			}
+			/* replace the last and sift down */
+			rest[nrest++] = keys[0].pflow;
+			for (i = 0; (j = i * 2 + 1) < n; i = j) {
+				if ((j + 1 < n) && key_before(&keys[j], &keys[j + 1]))
+					j++;
+				if (key_before(&keys[j], &key))
+					break;
+				keys[i] = keys[j];
+			}
+			keys[i] = key;
+		}
+	} else {
+		memcpy(rest, plist->list, sizeof(struct odflow *) * plist->size);
+		nrest = plist->size;
+	}
+
+	qsort(keys, n, sizeof(struct plot_key), key_comp);
+	for (i = 0; i < n; i++)
+		plist->list[i] = keys[i].pflow;
+	memcpy(&plist->list[n], rest, sizeof(struct odflow *) * nrest);
+	free(keys);
+	free(rest);
+}
+
+static void
+add_timeslot(struct odflow_hash *phash, struct odflow_list *pslot)
 {
-	struct odf_tailq *ptailq;
 	struct odflow *pflow;
-	int i, agrflow_index;
 
 	/* no traffic means no necessary to aggregate flows */
 	if (phash->nrecord == 0)
 		return;
 
-        for (i = 0; i < NBUCKETS; i++) {
-		if (phash->nrecord <= 0)
-			break;
-		ptailq = &phash->tbl[i];
-		phash->nrecord -= ptailq->nrecord;
-                while ((pflow = TAILQ_FIRST(&ptailq->odfq_head)) != NULL) {
-                        TAILQ_REMOVE(&ptailq->odfq_head, pflow, odf_chain);
-			ptailq->nrecord--;
-			agrflow_index = find_overlapped_agrflow(pflow);
-#if 0
-			printf("idx[%d] ", agrflow_index);
-			odflow_print(pflow);
-			printf("\n");
-#endif
-			param_update_plot_count(agrflow_index, pflow);
+	while ((pflow = hash_pop(phash)) != NULL) {
+		if (list_add(pslot, pflow) != 0) {
+			fprintf(stderr, "%s: malloc failed\n", __func__);
+			exit(1);
 		}
 	}
 }
 
+/* count the flows kept by others, e.g., an interval of the window */
+void
+plot_addlist(struct odflow_list *plist)
+{
+	map_flows(plist->list, plist->size);
+}
+
+/*
+ * count the flows of a slot.  the lookups only read the agrflow lists
+ * and their tries, so a long slot is split into jobs of PLOT_CHUNK
+ * flows run on the threads of -T.  a worker adds to counts of its own,
+ * and those are added to the slot at the end.
+ */
+static void
+map_flows(struct odflow **flows, uint64_t n)
+{
+	struct plot_map map;
+	uint64_t i, w, nthread;
+	int k;
+
+	nthread = max(query.nthread, 1);
+	if ((nthread == 1) || (n < 2 * PLOT_CHUNK)) {
+		for (i = 0; i < n; i++)
+			(void)count_results(flows[i]);
+		return;
+	}
+
+	map.flows  = flows;
+	map.nflow  = n;
+	map.ncnt   = 0;
+	map.offset = malloc(sizeof(uint64_t) * inparam.nresult);
+	map.lists  = malloc(sizeof(struct odflow_list *) * inparam.nresult);
+	map.tries  = malloc(sizeof(struct plot_trie *) * inparam.nresult);
+	if (map.offset == NULL || map.lists == NULL || map.tries == NULL)
+		goto err;
+	/* the tries are built before the workers share them */
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		if ((inparam.agrflow_list->size >= PT_MINFLOWS) &&
+		    (inparam.agrflow_trie == NULL))
+			inparam.agrflow_trie = ptrie_alloc(inparam.agrflow_list);
+		map.lists[k]  = inparam.agrflow_list;
+		map.tries[k]  = inparam.agrflow_trie;
+		map.offset[k] = map.ncnt;
+		map.ncnt += inparam.agrflow_list->size;
+	}
+	param_select_result(0);
+	if ((map.cnt = calloc(nthread * map.ncnt + 1, sizeof(uint64_t))) == NULL)
+		goto err;
+
+	sched_foreach((n + PLOT_CHUNK - 1) / PLOT_CHUNK, nthread, map_main, &map);
+
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		for (w = 0; w < nthread; w++)
+			for (i = 0; i < inparam.plots.ncnt; i++)
+				PLOT_COUNT(&inparam.plots, inparam.plot_index, i) +=
+				    map.cnt[w * map.ncnt + map.offset[k] + i];
+	}
+	param_select_result(0);
+	free(map.cnt);
+	free(map.offset);
+	free(map.lists);
+	free(map.tries);
+	return;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+/* a job of map_flows(): the i-th chunk of the flows */
+static void
+map_main(int worker, uint64_t i, void *arg)
+{
+	struct plot_map *pmap = arg;
+	struct odflow *pflow;
+	uint64_t *pcnt = &pmap->cnt[worker * pmap->ncnt];
+	uint64_t j, end;
+	int agrflow_index, k;
+
+	end = min((i + 1) * PLOT_CHUNK, pmap->nflow);
+	for (j = i * PLOT_CHUNK; j < end; j++) {
+		pflow = pmap->flows[j];
+		for (k = 0; k < inparam.nresult; k++) {
+			agrflow_index = agrflow_lookup(pmap->lists[k],
+			    pmap->tries[k], pflow);
+			if (agrflow_index < 0)
+				continue;
+			/* the criteria of a result is fixed */
+			pcnt[pmap->offset[k] + agrflow_index] +=
+			    (inparam.results[k].basis == PACKET) ?
+			    pflow->packet : pflow->byte;
+		}
+	}
+}
+
+/* count the flow in the agrflow covering it in each result */
+static int
+count_results(struct odflow *pflow)
+{
+	int agrflow_index, k, ncovered = 0;
+
+	for (k = 0; k < inparam.nresult; k++) {
+		param_select_result(k);
+		agrflow_index = find_overlapped_agrflow(pflow);
+		if (agrflow_index < 0)
+			continue;
+		param_update_plot_count(agrflow_index, pflow);
+		ncovered++;
+	}
+	param_select_result(0);
+	return (ncovered);
+}
+
 static int
 find_overlapped_agrflow(struct odflow *pflow)
+{
+	/* a long list is looked up on its trie */
+	if ((inparam.agrflow_list->size >= PT_MINFLOWS) &&
+	    (inparam.agrflow_trie == NULL))
+		inparam.agrflow_trie = ptrie_alloc(inparam.agrflow_list);
+	return agrflow_lookup(inparam.agrflow_list, inparam.agrflow_trie, pflow);
+}
+
+/* the first agrflow of the list covering the flow, or -1 */
+static int
+agrflow_lookup(struct odflow_list *plist, struct plot_trie *ptrie,
+    struct odflow *pflow)
 {
 	struct odflow *pagrflow;
 	uint64_t i;
 
-	// TODO do binary search instead of linear search
-	for (i = 0; i < inparam.agrflow_list->size; i++){
-		pagrflow = inparam.agrflow_list->list[i];
+	if (ptrie != NULL)
+		return ptrie_find(ptrie, pflow);
+	for (i = 0; i < plist->size; i++){
+		pagrflow = plist->list[i];
 		if (is_overlapped(pagrflow, pflow)){
 			break;
 		}
 	}
-	if (i == inparam.agrflow_list->size){
-		while(1);
-	}
+	/* no catch-all flow when the residual of * * is small */
+	if (i == plist->size)
+		return -1;
 	return i;
 }
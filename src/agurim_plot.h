@@ -35,5 +35,6 @@
 void plot_addcount(struct odflow* pflow);
 void plot_run(void);
 void plot_show(void);
+void plot_addlist(struct odflow_list *plist);
 
 #endif /* AGURIM_PLOT_H */
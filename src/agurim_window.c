@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * sliding-window HHH for a stream of aguri2 records (-w nwindow).
+ * the raw flows of the last nwindow intervals are kept in a ring, and
+ * the window hashes hold the sum of them.  at every interval, the new
+ * interval is added to the window and the expired one is subtracted,
+ * then the HHH runs on a copy of the window flows.
+ */
+
+#include <sys/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agurim_window.h"
+#include "agurim_param.h"
+#include "agurim_odflow.h"
+#include "agurim_hhh.h"
+#include "agurim_plot.h"
+#include "util/odflow_hash.h"
+#include "util/odflow_list.h"
+
+#define NHASH	3	/* IPv4, IPv6 and protocol flows */
+
+/* the raw flows of an interval */
+struct window_slot {
+	time_t start_time;
+	uint64_t byte, packet;
+	struct odflow_list *flows[NHASH];
+};
+
+static struct window_slot *ring;
+static int nring, head;		/* the oldest slot is ring[head] */
+static struct odflow_hash *win_hash[NHASH];
+static struct odflow_hash *main_hash[NHASH];	/* filled by read_in() */
+static uint64_t win_byte, win_packet;
+
+static void window_init(void);
+static void window_add(struct window_slot *pslot);
+static void window_expire(struct window_slot *pslot);
+static void window_fill(void);
+static void window_plot(void);
+
+/* a step of the window at the end of an interval */
+void
+window_run(void)
+{
+	struct window_slot *pslot;
+
+	if (ring == NULL)
+		window_init();
+
+	/* the slot of the oldest interval is reused for the new one */
+	pslot = &ring[(head + nring) % query.window];
+	if (nring == query.window) {
+		window_expire(pslot);
+		head = (head + 1) % query.window;
+		nring--;
+	}
+	pslot->start_time = inparam.start_time;
+	pslot->byte   = inparam.total_byte;
+	pslot->packet = inparam.total_packet;
+	window_add(pslot);
+	nring++;
+
+	/* the HHH of the window */
+	window_fill();
+	inparam.start_time   = ring[head].start_time;
+	inparam.total_byte   = win_byte;
+	inparam.total_packet = win_packet;
+	hhh_run();
+	if (query.outfmt != REAGGREGATION)
+		window_plot();
+	plot_show();
+	fflush(stdout);
+	param_reset_hhhmode();
+}
+
+static void
+window_init(void)
+{
+	int i;
+
+	ring = calloc(query.window, sizeof(struct window_slot));
+	if (ring == NULL)
+		goto err;
+	for (i = 0; i < NHASH; i++) {
+		if ((win_hash[i] = hash_alloc()) == NULL)
+			goto err;
+	}
+	main_hash[0] = ip_hash;
+	main_hash[1] = ip6_hash;
+	main_hash[2] = proto_hash;
+	return;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+/*
+ * move the flows of the interval from the main hashes to the slot,
+ * and add them to the window.  a window flow keeps the raw flows
+ * summed in it as the cache, in the order of the intervals.
+ */
+static void
+window_add(struct window_slot *pslot)
+{
+	struct odflow *pflow, *pwinflow;
+	int i;
+
+	for (i = 0; i < NHASH; i++) {
+		pslot->flows[i] = list_alloc(max(main_hash[i]->nrecord, 1));
+		if (pslot->flows[i] == NULL)
+			goto err;
+		while ((pflow = hash_pop(main_hash[i])) != NULL) {
+			list_add(pslot->flows[i], pflow);
+			pwinflow = hash_find(win_hash[i], &pflow->spec);
+			if (pwinflow == NULL)
+				goto err;
+			if (pwinflow->cache == NULL &&
+			    (pwinflow->cache = list_alloc(query.window)) == NULL)
+				goto err;
+			pwinflow->af      = pflow->af;
+			pwinflow->byte   += pflow->byte;
+			pwinflow->packet += pflow->packet;
+			list_add(pwinflow->cache, pflow);
+		}
+	}
+	win_byte   += pslot->byte;
+	win_packet += pslot->packet;
+	return;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+/* subtract the flows of the oldest interval from the window */
+static void
+window_expire(struct window_slot *pslot)
+{
+	struct odflow_list *pcache;
+	struct odflow *pflow, *pwinflow;
+	uint64_t j;
+	int i;
+
+	for (i = 0; i < NHASH; i++) {
+		for (j = 0; j < pslot->flows[i]->size; j++) {
+			pflow = pslot->flows[i]->list[j];
+			pwinflow = hash_find(win_hash[i], &pflow->spec);
+			pwinflow->byte   -= pflow->byte;
+			pwinflow->packet -= pflow->packet;
+
+			/* the oldest raw flow is the first of the cache */
+			pcache = pwinflow->cache;
+			memmove(&pcache->list[0], &pcache->list[1],
+			    sizeof(struct odflow *) * --pcache->size);
+			if (pcache->size == 0) {
+				hash_remove(win_hash[i], pwinflow);
+				odflow_free(pwinflow);
+			}
+			odflow_release(pflow);
+		}
+		list_free(pslot->flows[i]);
+		pslot->flows[i] = NULL;
+	}
+	win_byte   -= pslot->byte;
+	win_packet -= pslot->packet;
+}
+
+/*
+ * copy the window flows to the main hashes for the HHH.  the subflows
+ * of a window flow are those of its raw flows; the same subflow spec
+ * may appear more than once, and is merged by the subflow HHH.
+ * a bucket is visited backwards, as hash_add() inserts at the head.
+ */
+static void
+window_fill(void)
+{
+	struct odflow_hash *phash;
+	struct odflow *pwinflow, *pflow, *psubflow, *raw;
+	uint64_t j, k;
+	uint32_t u;
+	int i;
+
+	for (i = 0; i < NHASH; i++) {
+		phash = win_hash[i];
+		for (u = 0; u < phash->nused; u++) {
+			TAILQ_FOREACH_REVERSE(pwinflow,
+			    &phash->tbl[phash->used[u]].odfq_head, odfq, odf_chain) {
+				if ((pflow = odflow_alloc()) == NULL)
+					goto err;
+				pflow->spec   = pwinflow->spec;
+				pflow->af     = pwinflow->af;
+				pflow->byte   = pwinflow->byte;
+				pflow->packet = pwinflow->packet;
+				for (j = 0; j < pwinflow->cache->size; j++) {
+					raw = pwinflow->cache->list[j];
+					if (raw->subflow == NULL)
+						continue;
+					if (pflow->subflow == NULL &&
+					    (pflow->subflow = list_alloc(raw->subflow->size)) == NULL)
+						goto err;
+					for (k = 0; k < raw->subflow->size; k++) {
+						psubflow = odflow_dup(raw->subflow->list[k]);
+						list_add(pflow->subflow, psubflow);
+					}
+				}
+				(void)hash_add(main_hash[i], pflow);
+			}
+		}
+	}
+	return;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+/* the plot data of the aggregated flows over the intervals of the window */
+static void
+window_plot(void)
+{
+	struct window_slot *pslot;
+	int n, i;
+
+	param_set_window(nring);
+	for (n = 0; n < nring; n++) {
+		pslot = &ring[(head + n) % query.window];
+		for (i = 0; i < NHASH; i++)
+			plot_addlist(pslot->flows[i]);
+		param_update_cntlist_index(pslot->start_time);
+	}
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * microbenchmark of the prefix kernels: per-call cost of prefix_set(),
+ * prefix_comp() and is_overlapped() for IPv4 and IPv6 prefixes,
+ * against the former byte-by-byte versions kept here as a reference.
+ * also the lookup of the agrflow covering a flow in plot mode, on the
+ * trie of the list against the linear scan of the list.
+ */
+
+#include <sys/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../agurim_odflow.h"
+#include "../util/odflow_list.h"
+#include "../util/plot_trie.h"
+
+#define NSPEC	4096		/* working set of flow specs */
+#define NLOOP	(1 << 24)	/* calls per measurement */
+#define NLOOKUP	(1 << 20)	/* lookups per measurement */
+
+static uint8_t bytemask[8]
+    = { 0x00, 0x80, 0xc0, 0xe0, 0xf0, 0xf8, 0xfc, 0xfe };
+
+static struct odflow flows[NSPEC];
+static struct odflow parents[NSPEC];	/* a covering aggregate of flows[] */
+static int lens[NSPEC];
+static volatile int sink;
+
+static void
+byte_prefix_set(uint8_t *r0, uint8_t len, uint8_t *r1, int bytesize)
+{
+	uint8_t bits, bytes = len / 8;
+	uint8_t pad = bytesize - bytes;
+
+	bits = len & 7;
+	if (bits)
+		pad--;
+	while (bytes-- != 0)
+		*r1++ = *r0++;
+	if (bits != 0)
+		*r1++= *r0 & bytemask[bits];
+	while (pad--)
+		*r1++ = 0;
+}
+
+static int
+byte_prefix_comp(uint8_t *r, uint8_t *r2, uint8_t len)
+{
+	uint8_t bytes, bits, mask;
+
+	if (len == 0)
+		return (0);
+	bytes = len / 8;
+	bits = len & 7;
+	while (bytes-- != 0) {
+		if (*r++ != *r2++)
+			return (*--r - *--r2);
+	}
+	if ((mask = bytemask[bits]) == 0)
+		return (0);
+	return ((*r & mask) - (*r2 & mask));
+}
+
+static int
+byte_is_overlapped(struct odflow *p0, struct odflow *p1)
+{
+	if (p0->af != p1->af)
+		return 0;
+	if ((p0->spec.srclen > p1->spec.srclen) || (p0->spec.dstlen > p1->spec.dstlen))
+		return (0);
+	if (byte_prefix_comp(p0->spec.src, p1->spec.src, p0->spec.srclen) != 0 ||
+	    byte_prefix_comp(p0->spec.dst, p1->spec.dst, p0->spec.dstlen) != 0)
+		return (0);
+	return (1);
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/*
+ * flows sharing the upper half of the addresses, and an aggregate
+ * covering each flow, so that is_overlapped() matches the whole
+ * prefix as it does for the aggregates in plot mode.
+ */
+static void
+make_flows(int af)
+{
+	int i, j, nbyte = (af == AF_INET) ? 4 : 16;
+
+	for (i = 0; i < NSPEC; i++) {
+		memset(&flows[i], 0, sizeof(struct odflow));
+		flows[i].af = af;
+		for (j = 0; j < nbyte; j++) {
+			flows[i].spec.src[j] = (j < nbyte / 2) ? j : random();
+			flows[i].spec.dst[j] = (j < nbyte / 2) ? j : random();
+		}
+		flows[i].spec.srclen = random() % (nbyte * 8 + 1);
+		flows[i].spec.dstlen = random() % (nbyte * 8 + 1);
+		lens[i] = random() % (nbyte * 8 + 1);
+
+		parents[i] = flows[i];
+		parents[i].spec.srclen = random() % (flows[i].spec.srclen + 1);
+		parents[i].spec.dstlen = random() % (flows[i].spec.dstlen + 1);
+	}
+}
+
+static void
+check(int af)
+{
+	uint8_t a[MAXLEN], b[MAXLEN];
+	int i, j, bytesize = (af == AF_INET) ? 8 : 16;
+
+	for (i = 0; i < NSPEC; i++) {
+		j = (i * 7 + 1) % NSPEC;
+		memset(a, 0, sizeof(a));
+		memset(b, 0, sizeof(b));
+		prefix_set(flows[i].spec.src, lens[i], a, bytesize);
+		byte_prefix_set(flows[i].spec.src, lens[i], b, bytesize);
+		if (memcmp(a, b, sizeof(a)) != 0 ||
+		    prefix_comp(flows[i].spec.src, flows[j].spec.src, lens[i]) !=
+		    byte_prefix_comp(flows[i].spec.src, flows[j].spec.src, lens[i]) ||
+		    is_overlapped(&flows[i], &flows[j]) !=
+		    byte_is_overlapped(&flows[i], &flows[j]) ||
+		    !is_overlapped(&parents[i], &flows[i])) {
+			fprintf(stderr, "%s: mismatch at %d\n", __func__, i);
+			exit(1);
+		}
+	}
+}
+
+static void
+run(int af)
+{
+	uint8_t r[MAXLEN];
+	double t[6];
+	int i, k, n, bytesize = (af == AF_INET) ? 8 : 16;
+
+	make_flows(af);
+	check(af);
+
+	t[0] = now();
+	for (i = 0; i < NLOOP; i++) {
+		k = i & (NSPEC - 1);
+		prefix_set(flows[k].spec.src, lens[k], r, bytesize);
+		sink += r[0];
+	}
+	t[1] = now();
+	for (i = 0; i < NLOOP; i++) {
+		k = i & (NSPEC - 1);
+		byte_prefix_set(flows[k].spec.src, lens[k], r, bytesize);
+		sink += r[0];
+	}
+	t[2] = now();
+	for (i = 0, n = 0; i < NLOOP; i++) {
+		k = i & (NSPEC - 1);
+		n += prefix_comp(flows[k].spec.src,
+		    flows[(k + 1) & (NSPEC - 1)].spec.src, lens[k]);
+	}
+	t[3] = now();
+	for (i = 0; i < NLOOP; i++) {
+		k = i & (NSPEC - 1);
+		n += byte_prefix_comp(flows[k].spec.src,
+		    flows[(k + 1) & (NSPEC - 1)].spec.src, lens[k]);
+	}
+	t[4] = now();
+	sink += n;
+
+	printf("%s prefix_set     %6.2f ns/call (bytewise %6.2f)\n",
+	    (af == AF_INET) ? "IPv4" : "IPv6",
+	    (t[1] - t[0]) * 1e9 / NLOOP, (t[2] - t[1]) * 1e9 / NLOOP);
+	printf("%s prefix_comp    %6.2f ns/call (bytewise %6.2f)\n",
+	    (af == AF_INET) ? "IPv4" : "IPv6",
+	    (t[3] - t[2]) * 1e9 / NLOOP, (t[4] - t[3]) * 1e9 / NLOOP);
+
+	t[0] = now();
+	for (i = 0, n = 0; i < NLOOP; i++) {
+		k = i & (NSPEC - 1);
+		n += is_overlapped(&parents[k], &flows[k]);
+	}
+	t[1] = now();
+	for (i = 0; i < NLOOP; i++) {
+		k = i & (NSPEC - 1);
+		n += byte_is_overlapped(&parents[k], &flows[k]);
+	}
+	t[2] = now();
+	sink += n;
+
+	printf("%s is_overlapped  %6.2f ns/call (bytewise %6.2f)\n",
+	    (af == AF_INET) ? "IPv4" : "IPv6",
+	    (t[1] - t[0]) * 1e9 / NLOOP, (t[2] - t[1]) * 1e9 / NLOOP);
+}
+
+static int
+linear_find(struct odflow_list *plist, struct odflow *pflow)
+{
+	uint64_t i;
+
+	for (i = 0; i < plist->size; i++)
+		if (is_overlapped(plist->list[i], pflow))
+			return (i);
+	return (-1);
+}
+
+static int
+len_comp(const void *p0, const void *p1)
+{
+	struct odflow *pflow0 = *(struct odflow **)p0;
+	struct odflow *pflow1 = *(struct odflow **)p1;
+
+	return ((pflow1->spec.srclen + pflow1->spec.dstlen) -
+	    (pflow0->spec.srclen + pflow0->spec.dstlen));
+}
+
+/*
+ * nagr aggregates of the flows at 8-bit (IPv4) or 16-bit (IPv6)
+ * prefix lengths, in the order of the sum of the prefix lengths as
+ * HHH extracts them, and the catch-all at the end.
+ */
+static void
+run_lookup(int af, int nagr)
+{
+	struct odflow_list *plist;
+	struct plot_trie *ptrie;
+	struct odflow *pagr;
+	double t[3];
+	int i, k, n, step = (af == AF_INET) ? 8 : 16;
+	int maxlen = (af == AF_INET) ? 32 : 128;
+
+	make_flows(af);
+	for (i = 0; i < NSPEC; i++)
+		flows[i].spec.srclen = flows[i].spec.dstlen = maxlen;
+	plist = list_alloc(nagr);
+	for (i = 0; i < nagr - 1; i++) {
+		pagr = malloc(sizeof(struct odflow));
+		*pagr = flows[random() % NSPEC];
+		pagr->spec.srclen = step * (random() % (maxlen / step + 1));
+		pagr->spec.dstlen = step * (random() % (maxlen / step + 1));
+		list_add(plist, pagr);
+	}
+	qsort(plist->list, plist->size, sizeof(struct odflow *), len_comp);
+	pagr = calloc(1, sizeof(struct odflow));
+	pagr->af = af;
+	list_add(plist, pagr);
+	ptrie = ptrie_alloc(plist);
+
+	for (i = 0; i < NSPEC; i++) {
+		if (ptrie_find(ptrie, &flows[i]) != linear_find(plist, &flows[i])) {
+			fprintf(stderr, "%s: mismatch at %d\n", __func__, i);
+			exit(1);
+		}
+	}
+
+	t[0] = now();
+	for (i = 0, n = 0; i < NLOOKUP; i++) {
+		k = i & (NSPEC - 1);
+		n += ptrie_find(ptrie, &flows[k]);
+	}
+	t[1] = now();
+	for (i = 0; i < NLOOKUP; i++) {
+		k = i & (NSPEC - 1);
+		n += linear_find(plist, &flows[k]);
+	}
+	t[2] = now();
+	sink += n;
+
+	printf("%s lookup %4d agrflows %7.2f ns/call (linear %7.2f)\n",
+	    (af == AF_INET) ? "IPv4" : "IPv6", nagr,
+	    (t[1] - t[0]) * 1e9 / NLOOKUP, (t[2] - t[1]) * 1e9 / NLOOKUP);
+
+	ptrie_free(ptrie);
+	for (i = 0; i < (int)plist->size; i++)
+		free(plist->list[i]);
+	list_free(plist);
+}
+
+int
+main(int argc, char **argv)
+{
+	int nagr;
+
+	srandom(1);
+	run(AF_INET);
+	run(AF_INET6);
+	for (nagr = 16; nagr <= 1024; nagr *= 4) {
+		run_lookup(AF_INET, nagr);
+		run_lookup(AF_INET6, nagr);
+	}
+	return (0);
+}
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+
+#include "file_output.h"
+
+static char *out_reserve(size_t len);
+static void out_mem(const char *s, size_t len);
+static char *fmt_u64(char *end, uint64_t v);
+static char *fmt_hex16(char *p, uint16_t v);
+static char *fmt_ip4(char *p, uint8_t *ip);
+static char *fmt_2d(char *p, int v);
+
+static char out_buf[OUT_BUFSIZE];
+static size_t out_len;
+
+/* the decimal digits of 00 to 99, two characters each */
+static const char digits2[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static const char *wday_name[7] = {
+	"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+static const char *mon_name[12] = {
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+void
+out_flush(void)
+{
+	if (out_len > 0)
+		fwrite(out_buf, 1, out_len, stdout);
+	out_len = 0;
+}
+
+/* room for len bytes at the end of the buffer, len <= OUT_BUFSIZE */
+static char *
+out_reserve(size_t len)
+{
+	if (out_len + len > OUT_BUFSIZE)
+		out_flush();
+	return (out_buf + out_len);
+}
+
+static void
+out_mem(const char *s, size_t len)
+{
+	size_t n;
+
+	while (len > 0) {
+		if (out_len == OUT_BUFSIZE)
+			out_flush();
+		n = OUT_BUFSIZE - out_len;
+		if (n > len)
+			n = len;
+		memcpy(out_buf + out_len, s, n);
+		out_len += n;
+		s += n;
+		len -= n;
+	}
+}
+
+void
+out_char(int c)
+{
+	if (out_len == OUT_BUFSIZE)
+		out_flush();
+	out_buf[out_len++] = c;
+}
+
+void
+out_str(const char *s)
+{
+	out_mem(s, strlen(s));
+}
+
+/* the digits of v ending at end, two at a time; returns the first */
+static char *
+fmt_u64(char *end, uint64_t v)
+{
+	char *p = end;
+	unsigned r;
+
+	while (v >= 100) {
+		r = v % 100;
+		v /= 100;
+		p -= 2;
+		memcpy(p, &digits2[r * 2], 2);
+	}
+	if (v >= 10) {
+		p -= 2;
+		memcpy(p, &digits2[v * 2], 2);
+	} else
+		*--p = '0' + v;
+	return (p);
+}
+
+void
+out_u64(uint64_t v)
+{
+	char tmp[20];
+	char *p;
+
+	p = fmt_u64(tmp + sizeof(tmp), v);
+	out_mem(p, tmp + sizeof(tmp) - p);
+}
+
+void
+out_i64(int64_t v)
+{
+	if (v < 0) {
+		out_char('-');
+		out_u64(-(uint64_t)v);
+	} else
+		out_u64(v);
+}
+
+/*
+ * the same text as printf("%.2f", v).  v * 100 is rounded to an
+ * integer here unless it is within the rounding error from a half, or
+ * too large for the error to be small, which is left to printf.
+ */
+void
+out_fixed2(double v)
+{
+	char tmp[24];
+	char *p, *end;
+	double y, frac;
+	uint64_t n;
+
+	if (!(v >= 0.0) || signbit(v) || v >= 42949672.0) {
+		out_printf("%.2f", v);
+		return;
+	}
+	y = v * 100;
+	n = (uint64_t)y;
+	frac = y - n;
+	if (frac > 0.500001)
+		n++;
+	else if (frac >= 0.499999) {
+		out_printf("%.2f", v);
+		return;
+	}
+	end = tmp + sizeof(tmp);
+	p = end - 3;
+	memcpy(p + 1, &digits2[(n % 100) * 2], 2);
+	*p = '.';
+	p = fmt_u64(p, n / 100);
+	out_mem(p, end - p);
+}
+
+/* the formats having no hand-written version, e.g., the floats */
+void
+out_printf(const char *fmt, ...)
+{
+	va_list ap;
+	size_t room;
+	int n;
+
+	room = OUT_BUFSIZE - out_len;
+	va_start(ap, fmt);
+	n = vsnprintf(out_buf + out_len, room, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	if ((size_t)n >= room) {
+		out_flush();
+		va_start(ap, fmt);
+		if (n < OUT_BUFSIZE)
+			n = vsnprintf(out_buf, OUT_BUFSIZE, fmt, ap);
+		else {
+			vfprintf(stdout, fmt, ap);
+			n = 0;
+		}
+		va_end(ap);
+	}
+	out_len += n;
+}
+
+/* the lower case hex digits of v without the leading zeros */
+static char *
+fmt_hex16(char *p, uint16_t v)
+{
+	if (v >= 0x1000)
+		*p++ = hexdigits[v >> 12];
+	if (v >= 0x100)
+		*p++ = hexdigits[(v >> 8) & 0xf];
+	if (v >= 0x10)
+		*p++ = hexdigits[(v >> 4) & 0xf];
+	*p++ = hexdigits[v & 0xf];
+	return (p);
+}
+
+static char *
+fmt_ip4(char *p, uint8_t *ip)
+{
+	int i, v;
+
+	for (i = 0; i < 4; i++) {
+		if (i > 0)
+			*p++ = '.';
+		v = ip[i];
+		if (v >= 100) {
+			*p++ = '0' + v / 100;
+			memcpy(p, &digits2[(v % 100) * 2], 2);
+			p += 2;
+		} else if (v >= 10) {
+			memcpy(p, &digits2[v * 2], 2);
+			p += 2;
+		} else
+			*p++ = '0' + v;
+	}
+	return (p);
+}
+
+/* the same text as inet_ntop(AF_INET) */
+void
+out_ip4(uint8_t *ip)
+{
+	char *p;
+
+	p = out_reserve(16);
+	out_len += fmt_ip4(p, ip) - p;
+}
+
+/*
+ * the same text as inet_ntop(AF_INET6): the first longest run of two
+ * or more zero words is "::", and the IPv4-compatible and IPv4-mapped
+ * addresses end with the dotted quad.
+ */
+void
+out_ip6(uint8_t *ip6)
+{
+	uint16_t words[8];
+	int base = -1, len = 0, cur = -1, i;
+	char *p, *start;
+
+	for (i = 0; i < 8; i++) {
+		words[i] = (ip6[i * 2] << 8) | ip6[i * 2 + 1];
+		if (words[i] == 0) {
+			if (cur < 0)
+				cur = i;
+			if (i - cur + 1 > len) {
+				base = cur;
+				len = i - cur + 1;
+			}
+		} else
+			cur = -1;
+	}
+	if (len < 2)
+		base = -1;
+
+	start = p = out_reserve(48);
+	for (i = 0; i < 8; i++) {
+		if (base >= 0 && i >= base && i < base + len) {
+			if (i == base)
+				*p++ = ':';
+			continue;
+		}
+		if (i != 0)
+			*p++ = ':';
+		if (i == 6 && base == 0 &&
+		    (len == 6 || (len == 5 && words[5] == 0xffff))) {
+			p = fmt_ip4(p, ip6 + 12);
+			break;
+		}
+		p = fmt_hex16(p, words[i]);
+	}
+	if (base >= 0 && base + len == 8)
+		*p++ = ':';
+	out_len += p - start;
+}
+
+static char *
+fmt_2d(char *p, int v)
+{
+	memcpy(p, &digits2[v * 2], 2);
+	return (p + 2);
+}
+
+/* the same text as strftime("%a %b %d %T %Y") in the C locale */
+void
+out_date(const struct tm *tm)
+{
+	char *p, *start;
+
+	start = p = out_reserve(24);
+	memcpy(p, wday_name[tm->tm_wday], 3);
+	p[3] = ' ';
+	memcpy(p + 4, mon_name[tm->tm_mon], 3);
+	p[7] = ' ';
+	p = fmt_2d(p + 8, tm->tm_mday);
+	*p++ = ' ';
+	p = fmt_2d(p, tm->tm_hour);
+	*p++ = ':';
+	p = fmt_2d(p, tm->tm_min);
+	*p++ = ':';
+	p = fmt_2d(p, tm->tm_sec);
+	*p++ = ' ';
+	out_len += p - start;
+	out_i64((int64_t)tm->tm_year + 1900);
+}
+
+/* the same text as strftime("%Y/%m/%d %T") */
+void
+out_datetime(const struct tm *tm)
+{
+	char *p, *start;
+
+	out_i64((int64_t)tm->tm_year + 1900);
+	start = p = out_reserve(16);
+	*p++ = '/';
+	p = fmt_2d(p, tm->tm_mon + 1);
+	*p++ = '/';
+	p = fmt_2d(p, tm->tm_mday);
+	*p++ = ' ';
+	p = fmt_2d(p, tm->tm_hour);
+	*p++ = ':';
+	p = fmt_2d(p, tm->tm_min);
+	*p++ = ':';
+	p = fmt_2d(p, tm->tm_sec);
+	out_len += p - start;
+}
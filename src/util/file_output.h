@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FILE_OUTPUT_H
+#define FILE_OUTPUT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define OUT_BUFSIZE	(1024 * 1024)	/* bytes buffered for a write */
+
+/*
+ * the text output goes to a buffer in front of stdout, and out_flush()
+ * writes it out.  the output of stdio has to be flushed with
+ * out_flush() before it, to keep the order.
+ */
+void out_flush(void);
+void out_char(int c);
+void out_str(const char *s);
+void out_u64(uint64_t v);
+void out_i64(int64_t v);
+void out_fixed2(double v);
+void out_printf(const char *fmt, ...);
+void out_ip4(uint8_t *ip);
+void out_ip6(uint8_t *ip6);
+void out_date(const struct tm *tm);
+void out_datetime(const struct tm *tm);
+
+#endif /* FILE_OUTPUT_H */
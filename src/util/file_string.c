@@ -37,6 +37,7 @@
 #include <ctype.h>
 
 #include "file_string.h"
+#include "file_output.h"
 #include "../agurim_param.h"
 
 static int create_ip(char *buf, void *ip, uint8_t *prefixlen);
@@ -48,32 +49,28 @@ static time_t parse_time(char *buf);
 void
 ip_print(uint8_t *ip, uint8_t len)
 {
-	char buf[BUFSIZ];
-
 	if (len == 0)
-		printf("*");
+		out_char('*');
 	else {
-		inet_ntop(AF_INET, ip, buf, BUFSIZ);
-		if (len < 32)
-			printf("%s/%u", buf, len);
-		else
-			printf("%s", buf);
+		out_ip4(ip);
+		if (len < 32) {
+			out_char('/');
+			out_u64(len);
+		}
 	}
 }
 
 void
 ip6_print(uint8_t *ip6, uint8_t len)
 {
-	char buf[BUFSIZ];
-
 	if (len == 0)
-		printf("*::");
+		out_str("*::");
 	else {
-		inet_ntop(AF_INET6, ip6, buf, BUFSIZ);
-	if (len < 128)
-		printf("%s/%u", buf, len);
-	else
-		printf("%s", buf);
+		out_ip6(ip6);
+		if (len < 128) {
+			out_char('/');
+			out_u64(len);
+		}
 	}
 }
 
@@ -81,9 +78,9 @@ void
 proto_print(uint8_t proto)
 {
 	if (proto == 0)
-		printf("*");
+		out_char('*');
 	else
-		printf("%d", proto);
+		out_u64(proto);
 }
 
 void
@@ -93,13 +90,14 @@ port_print(uint8_t *pport, uint8_t len)
 
 	port = (pport[1] << 8) + pport[2];
 	if (port != 0) {
-		printf("%d", port);
+		out_u64(port);
 		if (len < 24) {  /* port range */
 			int end = port + (1 << (24 - len)) - 1;
-			printf("-%d", end);
+			out_char('-');
+			out_i64(end);
 		}
 	} else
-		printf("*");
+		out_char('*');
 }
 
 /*
@@ -0,0 +1,726 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../agurim_odflow.h"
+#include "../agurim_param.h"
+#include "hhh_reduce.h"
+#include "hhh_task.h"
+#include "hhh_util.h"
+#include "odflow_hash.h"
+#include "odflow_list.h"
+
+/*
+ * sort-and-reduce engine for the HHH overlapping algorithm.
+ * instead of hashing every finer flow for every label (create_hh()),
+ * the aggregates of a label are derived from the aggregates of its
+ * next-finer label: the keys of the finer aggregates are masked to the
+ * label, sorted and reduced into runs of the same key.
+ * only the aggregates exceeding the threshold are put into the task hash,
+ * so that find_hh() works as it does for create_hh().
+ * the aggregates are put in the order of their first member flows as
+ * create_hh() visits them, with their members in that order, so both
+ * engines extract the aggregates in the same order.
+ *
+ * in incremental mode (-I), the order of the keys of each label is kept
+ * for the next interval.  on stable traffic most of the flows come again,
+ * and an entry whose member flow has been seen takes the position of the
+ * flow's key in the last interval.  these entries are ordered by counting,
+ * and only the entries of new keys are sorted.
+ */
+
+/* helper for ordering the entries: the entry index breaks the ties */
+struct order_entry {
+	struct reduce_group group;
+	uint64_t pos;
+};
+
+static struct reduce_seed *v4_seed;
+static struct reduce_seed *v6_seed;
+
+static struct reduce_group *
+collect_level(struct hhh_task *ptask, uint64_t *nentry, uint64_t *nmember);
+static struct reduce_group *
+collect_list(struct hhh_task *ptask, uint64_t *nentry, uint64_t *nmember);
+static uint64_t
+reduce_entry(struct hhh_task *ptask, struct reduce_group *entry,
+    uint64_t nentry, struct odflow **member);
+static void
+add_group(struct hhh_task *ptask, struct reduce_group *pgroup);
+static void
+order_entry(struct reduce_seed *pseed, uint32_t level,
+    struct reduce_group *entry, uint64_t nentry);
+static uint32_t
+entry_rank(struct reduce_seed *pseed, uint32_t level,
+    struct reduce_group *pgroup);
+static int64_t
+seed_lookup(struct reduce_seed *pseed, struct odflow_spec *pspec);
+static uint64_t seed_hash(struct odflow_spec *pspec);
+static void level_free(struct reduce_level *plevel);
+static int is_residual(struct odflow *pflow);
+static int entry_comp(const void *p0, const void *p1);
+static int member_comp(const void *p0, const void *p1);
+static int heavy_comp(const void *p0, const void *p1);
+static int order_comp(const void *p0, const void *p1);
+
+struct reduce_lattice *
+reduce_alloc(int (*labels)[2], uint32_t nlabel, uint32_t bytesize)
+{
+	struct reduce_lattice *plattice;
+	struct reduce_level *plevel;
+	int i, j;
+
+	plattice = malloc(sizeof(struct reduce_lattice));
+	if (plattice == NULL)
+		goto end;
+	plattice->level = calloc(nlabel, sizeof(struct reduce_level));
+	if (plattice->level == NULL)
+		goto err;
+	plattice->labels   = labels;
+	plattice->nlabel   = nlabel;
+	plattice->bytesize = bytesize;
+	plattice->seed     = NULL;
+
+	/* the parent is the latest label covering this label */
+	for (i = 0; i < (int)nlabel; i++) {
+		plevel = &plattice->level[i];
+		plevel->parent = -1;
+		for (j = i - 1; j >= 0; j--) {
+			if ((labels[j][0] >= labels[i][0]) &&
+			    (labels[j][1] >= labels[i][1])) {
+				plevel->parent = j;
+				plattice->level[j].nref++;
+				break;
+			}
+		}
+	}
+end:
+	return plattice;
+err:
+	free(plattice);
+	plattice = NULL;
+	goto end;
+}
+
+void
+reduce_hh(struct hhh_task *ptask)
+{
+	struct reduce_lattice *plattice = ptask->lattice;
+	struct reduce_level *plevel;
+	struct reduce_group *entry;
+	struct odflow **member;
+	uint64_t nentry, nmember, ngroup;
+
+	if (plattice == NULL)
+		entry = collect_list(ptask, &nentry, &nmember);
+	else
+		entry = collect_level(ptask, &nentry, &nmember);
+	member = malloc(sizeof(struct odflow *) * max(nmember, 1));
+	if (entry == NULL || member == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	ngroup = reduce_entry(ptask, entry, nentry, member);
+
+	if (plattice == NULL) {
+		/* the member flows of a child task live with the task */
+		free(entry);
+		ptask->member = member;
+		return;
+	}
+
+	/*
+	 * keep the groups while finer-to-coarser derivation needs them,
+	 * and the member flows until the task is done.
+	 */
+	plevel = &plattice->level[ptask->level];
+	plevel->group  = entry;
+	plevel->ngroup = ngroup;
+	plevel->member = member;
+}
+
+/*
+ * skip a label that no coarser label derives from.
+ * returns 0 if the groups of the label are needed by other labels.
+ */
+int
+reduce_skip(struct hhh_task *ptask)
+{
+	struct reduce_lattice *plattice = ptask->lattice;
+
+	if (plattice == NULL || plattice->level[ptask->level].nref != 0)
+		return 0;
+	return 1;
+}
+
+/*
+ * release the levels no longer needed after the label of the task.
+ * the aggregates of the label and its child tasks refer to the member
+ * flows of the level, so this is called when the task is freed.
+ */
+void
+reduce_done(struct hhh_task *ptask)
+{
+	struct reduce_lattice *plattice = ptask->lattice;
+	struct reduce_level *plevel, *pparent;
+
+	plevel = &plattice->level[ptask->level];
+	if (plevel->nref == 0)
+		level_free(plevel);
+	if (plevel->parent >= 0) {
+		pparent = &plattice->level[plevel->parent];
+		if (--pparent->nref == 0)
+			level_free(pparent);
+	}
+
+	/* the last label releases the lattice */
+	if (ptask->level == plattice->nlabel - 1) {
+		free(plattice->level);
+		free(plattice);
+	}
+}
+
+/*
+ * make the entries of a label: the aggregates of the parent label, and
+ * the flows newly covered by this label as single member entries.
+ * the new flows are found in the buckets of the list index.
+ */
+static struct reduce_group *
+collect_level(struct hhh_task *ptask, uint64_t *nentry, uint64_t *nmember)
+{
+	struct reduce_lattice *plattice = ptask->lattice;
+	struct reduce_level *pparent = NULL;
+	struct reduce_group *entry, *pgroup;
+	struct list_index *pindex = ptask->index;
+	struct odflow *pflow;
+	int *label, *plabel = NULL;
+	uint64_t i, n, size, slot;
+	uint32_t s, d;
+
+	label = plattice->labels[ptask->level];
+	size = ptask->end;
+	if (plattice->level[ptask->level].parent >= 0) {
+		pparent = &plattice->level[plattice->level[ptask->level].parent];
+		plabel  = plattice->labels[plattice->level[ptask->level].parent];
+		size   += pparent->ngroup;
+	}
+	entry = malloc(sizeof(struct reduce_group) * max(size, 1));
+	if (entry == NULL)
+		return NULL;
+
+	n = 0;
+	*nmember = 0;
+	if (pparent != NULL) {
+		for (i = 0; i < pparent->ngroup; i++) {
+			pgroup = &pparent->group[i];
+			entry[n].spec = create_spec(&pgroup->spec, label,
+			    plattice->bytesize);
+			entry[n].member  = pgroup->member;
+			entry[n].nmember = pgroup->nmember;
+			entry[n].seed    = pgroup->seed;
+			*nmember += pgroup->nmember;
+			n++;
+		}
+	}
+	for (s = label[0]; s <= pindex->maxlen; s++) {
+		for (d = label[1]; d <= pindex->maxlen; d++) {
+			/* already counted in the parent aggregates */
+			if ((plabel != NULL) && (s >= plabel[0]) && (d >= plabel[1]))
+				continue;
+			slot = INDEX_SLOT(pindex, s, d);
+			for (i = pindex->start[slot];
+			    i < pindex->start[slot] + pindex->count[slot]; i++) {
+				pflow = ptask->list->list[i];
+				if (!is_residual(pflow))
+					continue;
+				entry[n].spec = create_spec(&pflow->spec, label,
+				    plattice->bytesize);
+				entry[n].member  = &ptask->list->list[i];
+				entry[n].nmember = 1;
+				entry[n].seed    = (plattice->seed != NULL) ?
+				    plattice->seed->prev[i] : -1;
+				*nmember += 1;
+				n++;
+			}
+		}
+	}
+	*nentry = n;
+	return entry;
+}
+
+/* make single member entries from the task list (the parent cache) */
+static struct reduce_group *
+collect_list(struct hhh_task *ptask, uint64_t *nentry, uint64_t *nmember)
+{
+	struct reduce_group *entry;
+	struct odflow *pflow;
+	uint64_t i, n;
+
+	entry = malloc(sizeof(struct reduce_group) * max(ptask->end, 1));
+	if (entry == NULL)
+		return NULL;
+
+	n = 0;
+	for (i = 0; i < (uint64_t)ptask->end; i++) {
+		pflow = ptask->list->list[i];
+		if (pflow == NULL || !is_residual(pflow))
+			continue;
+		if ((pflow->spec.srclen < ptask->label[0]) ||
+		    (pflow->spec.dstlen < ptask->label[1]))
+			continue;
+		entry[n].spec = create_spec(&pflow->spec, ptask->label,
+		    ptask->bytesize);
+		entry[n].member  = &ptask->list->list[i];
+		entry[n].nmember = 1;
+		entry[n].seed    = -1;
+		n++;
+	}
+	*nentry = n;
+	*nmember = n;
+	return entry;
+}
+
+/*
+ * sort the entries by key and reduce each run into a group.
+ * the member flows of a group are packed into member[], dropping flows
+ * already extracted (they never count again), and the groups overwrite
+ * the head of entry[].  returns the number of groups.
+ */
+static uint64_t
+reduce_entry(struct hhh_task *ptask, struct reduce_group *entry,
+    uint64_t nentry, struct odflow **member)
+{
+	struct reduce_seed *pseed = NULL;
+	struct reduce_group *pgroup, **heavy;
+	struct odflow *pflow;
+	struct odflow hh;
+	uint32_t *next = NULL;
+	uint64_t i, j, k, m, start, ngroup, nheavy;
+	int64_t seed;
+
+	if ((ptask->lattice != NULL) && (ptask->lattice->seed != NULL)) {
+		pseed = ptask->lattice->seed;
+		next = pseed->next_rank[ptask->level];
+	}
+	order_entry(pseed, ptask->level, entry, nentry);
+
+	heavy = malloc(sizeof(struct reduce_group *) * max(nentry, 1));
+	if (heavy == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	ngroup = 0;
+	nheavy = 0;
+	m = 0;
+	for (i = 0; i < nentry; i = j) {
+		memset(&hh, 0, sizeof(struct odflow));
+		start = m;
+		seed = -1;
+		for (j = i; j < nentry; j++) {
+			if (memcmp(&entry[j].spec, &entry[i].spec,
+			    sizeof(struct odflow_spec)) != 0)
+				break;
+			if (seed < 0)
+				seed = entry[j].seed;
+			for (k = 0; k < entry[j].nmember; k++) {
+				pflow = entry[j].member[k];
+				if (!is_residual(pflow))
+					continue;
+				member[m++] = pflow;
+				if (next != NULL)
+					next[pflow->list_index] = ngroup;
+				hh.byte   += pflow->byte;
+				hh.packet += pflow->packet;
+				hh.af      = pflow->af;
+			}
+		}
+		if (m == start)
+			continue;
+
+		/* ngroup <= i, so the run has been read already */
+		pgroup = &entry[ngroup++];
+		if (pgroup != &entry[i])
+			pgroup->spec = entry[i].spec;
+		pgroup->member  = &member[start];
+		pgroup->nmember = m - start;
+		pgroup->seed    = seed;
+
+		if (check_thresh(ptask->ctx, &hh)) {
+			qsort(pgroup->member, pgroup->nmember,
+			    sizeof(struct odflow *), member_comp);
+			heavy[nheavy++] = pgroup;
+		}
+	}
+
+	/* put the aggregates in the order create_hh() finds them */
+	qsort(heavy, nheavy, sizeof(struct reduce_group *), heavy_comp);
+	for (i = 0; i < nheavy; i++)
+		add_group(ptask, heavy[i]);
+	free(heavy);
+	if (pseed != NULL)
+		pseed->next_nrank[ptask->level] = ngroup;
+	return ngroup;
+}
+
+/*
+ * sort the entries by key.  the entries of the keys seen in the last
+ * interval are counted into the spans of their ranks, the others are
+ * sorted, and the two sequences are merged.  the entries of a key keep
+ * their order as in the stable sort.
+ * when less than half of the entries are seen, qsort() is cheaper.
+ */
+static void
+order_entry(struct reduce_seed *pseed, uint32_t level,
+    struct reduce_group *entry, uint64_t nentry)
+{
+	struct order_entry *sorted;
+	uint32_t *rank;
+	uint64_t *off;
+	uint64_t i, j, k, nseed, nrest;
+
+	if ((pseed == NULL) || (pseed->rank == NULL))
+		goto sort;
+	rank = malloc(sizeof(uint32_t) * max(nentry, 1));
+	off = calloc(pseed->nrank[level] + 1, sizeof(uint64_t));
+	if (rank == NULL || off == NULL)
+		goto err;
+
+	/* count the entries of each rank */
+	nseed = 0;
+	for (i = 0; i < nentry; i++) {
+		rank[i] = entry_rank(pseed, level, &entry[i]);
+		if (rank[i] != RANK_NONE) {
+			off[rank[i]]++;
+			nseed++;
+		}
+	}
+	if (nseed < nentry / 2) {
+		free(rank);
+		free(off);
+		goto sort;
+	}
+	sorted = malloc(sizeof(struct order_entry) * max(nentry, 1));
+	if (sorted == NULL)
+		goto err;
+	for (i = 0, k = 0; i < pseed->nrank[level]; i++) {
+		j = off[i];
+		off[i] = k;
+		k += j;
+	}
+
+	/* scatter the entries by rank, and sort the others */
+	nrest = 0;
+	for (i = 0; i < nentry; i++) {
+		if (rank[i] != RANK_NONE)
+			k = off[rank[i]]++;
+		else
+			k = nseed + nrest++;
+		sorted[k].group = entry[i];
+		sorted[k].pos   = i;
+	}
+	qsort(&sorted[nseed], nrest, sizeof(struct order_entry), order_comp);
+
+	for (i = 0, j = nseed, k = 0; k < nentry; k++) {
+		if ((j == nentry) ||
+		    ((i < nseed) && (order_comp(&sorted[i], &sorted[j]) < 0)))
+			entry[k] = sorted[i++].group;
+		else
+			entry[k] = sorted[j++].group;
+	}
+	free(sorted);
+	free(rank);
+	free(off);
+	return;
+sort:
+	qsort(entry, nentry, sizeof(struct reduce_group), entry_comp);
+	return;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+/* the rank of the key of a member flow seen in the last interval */
+static uint32_t
+entry_rank(struct reduce_seed *pseed, uint32_t level,
+    struct reduce_group *pgroup)
+{
+	if (pgroup->seed < 0)
+		return (RANK_NONE);
+	return (pseed->rank[level][pgroup->seed]);
+}
+
+/*
+ * the seed of the address family for this interval: find the flows of
+ * the list in the last interval, and prepare the ranks to record.
+ * the ranks of the last interval are dropped if the labels differ.
+ */
+struct reduce_seed *
+reduce_seed(int af, int (*labels)[2], uint32_t nlabel,
+    struct odflow_list *plist)
+{
+	struct reduce_seed **ppseed, *pseed;
+	uint64_t i;
+	uint32_t l;
+
+	ppseed = (af == AF_INET) ? &v4_seed : &v6_seed;
+	if (*ppseed == NULL) {
+		*ppseed = calloc(1, sizeof(struct reduce_seed));
+		if (*ppseed == NULL)
+			goto err;
+	}
+	pseed = *ppseed;
+	if ((pseed->nlabel != nlabel) || (memcmp(pseed->labels, labels,
+	    sizeof(int) * 2 * nlabel) != 0)) {
+		if (pseed->rank != NULL) {
+			for (l = 0; l < pseed->nlabel; l++)
+				free(pseed->rank[l]);
+			free(pseed->rank);
+			free(pseed->nrank);
+			pseed->rank  = NULL;
+			pseed->nrank = NULL;
+		}
+		pseed->nspec = 0;
+		free(pseed->labels);
+		pseed->labels = malloc(sizeof(int) * 2 * nlabel);
+		if (pseed->labels == NULL)
+			goto err;
+		memcpy(pseed->labels, labels, sizeof(int) * 2 * nlabel);
+		pseed->nlabel = nlabel;
+	}
+
+	pseed->prev = malloc(sizeof(int64_t) * max(plist->size, 1));
+	pseed->next_rank  = calloc(nlabel, sizeof(uint32_t *));
+	pseed->next_nrank = calloc(nlabel, sizeof(uint32_t));
+	if (pseed->prev == NULL || pseed->next_rank == NULL ||
+	    pseed->next_nrank == NULL)
+		goto err;
+	for (i = 0; i < plist->size; i++) {
+		if (pseed->nspec > 0)
+			pseed->prev[i] = seed_lookup(pseed,
+			    &plist->list[i]->spec);
+		else
+			pseed->prev[i] = -1;
+	}
+	for (l = 0; l < nlabel; l++) {
+		pseed->next_rank[l] = malloc(sizeof(uint32_t) *
+		    max(plist->size, 1));
+		if (pseed->next_rank[l] == NULL)
+			goto err;
+		memset(pseed->next_rank[l], 0xff,
+		    sizeof(uint32_t) * max(plist->size, 1));
+	}
+	return (pseed);
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+/*
+ * keep the flows and the ranks of this interval for the next one.
+ * plist is NULL when the address family had no flow.
+ */
+void
+reduce_seed_commit(int af, struct odflow_list *plist)
+{
+	struct reduce_seed *pseed;
+	uint64_t i, h, nslot;
+	uint32_t l;
+
+	pseed = (af == AF_INET) ? v4_seed : v6_seed;
+	if (pseed == NULL)
+		return;
+	if (pseed->rank != NULL) {
+		for (l = 0; l < pseed->nlabel; l++)
+			free(pseed->rank[l]);
+		free(pseed->rank);
+		free(pseed->nrank);
+	}
+	free(pseed->prev);
+	pseed->prev = NULL;
+	pseed->rank  = pseed->next_rank;
+	pseed->nrank = pseed->next_nrank;
+	pseed->next_rank  = NULL;
+	pseed->next_nrank = NULL;
+	if ((plist == NULL) || (pseed->rank == NULL)) {
+		pseed->nspec = 0;
+		return;
+	}
+
+	free(pseed->spec);
+	free(pseed->slot);
+	for (nslot = 16; nslot < plist->size * 2; nslot <<= 1)
+		;
+	pseed->spec = malloc(sizeof(struct odflow_spec) * max(plist->size, 1));
+	pseed->slot = malloc(sizeof(int64_t) * nslot);
+	if (pseed->spec == NULL || pseed->slot == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	pseed->nspec = plist->size;
+	pseed->nslot = nslot;
+	for (i = 0; i < nslot; i++)
+		pseed->slot[i] = -1;
+	for (i = 0; i < plist->size; i++) {
+		pseed->spec[i] = plist->list[i]->spec;
+		h = seed_hash(&pseed->spec[i]) & (nslot - 1);
+		while (pseed->slot[h] >= 0)
+			h = (h + 1) & (nslot - 1);
+		pseed->slot[h] = i;
+	}
+}
+
+static int64_t
+seed_lookup(struct reduce_seed *pseed, struct odflow_spec *pspec)
+{
+	uint64_t h;
+	int64_t i;
+
+	h = seed_hash(pspec) & (pseed->nslot - 1);
+	while ((i = pseed->slot[h]) >= 0) {
+		if (memcmp(&pseed->spec[i], pspec,
+		    sizeof(struct odflow_spec)) == 0)
+			return (i);
+		h = (h + 1) & (pseed->nslot - 1);
+	}
+	return (-1);
+}
+
+static uint64_t
+seed_hash(struct odflow_spec *pspec)
+{
+	uint64_t w[4], h;
+
+	/* src and dst are contiguous */
+	memcpy(w, pspec->src, sizeof(w));
+	h  = (w[0] ^ (w[1] * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+	h ^= (w[2] ^ (w[3] * 0x9e3779b97f4a7c15ULL)) * 0xc4ceb9fe1a85ec53ULL;
+	h ^= ((uint64_t)pspec->srclen << 8 | pspec->dstlen) *
+	    0x9e3779b97f4a7c15ULL;
+	return (h ^ (h >> 29));
+}
+
+static void
+add_group(struct hhh_task *ptask, struct reduce_group *pgroup)
+{
+	struct odflow *pagrflow, *pflow;
+	uint64_t i;
+
+	pagrflow = hash_find(ptask->hash, &pgroup->spec);
+	if (pagrflow == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	for (i = 0; i < pgroup->nmember; i++) {
+		pflow = pgroup->member[i];
+		pagrflow->byte   += pflow->byte;
+		pagrflow->packet += pflow->packet;
+		pagrflow->af      = pflow->af;
+	}
+
+	/* the members are in the member array of the level or the task */
+	pagrflow->cache = list_view(pgroup->member, pgroup->nmember);
+	if (pagrflow->cache == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+}
+
+static void
+level_free(struct reduce_level *plevel)
+{
+	free(plevel->group);
+	free(plevel->member);
+	plevel->group  = NULL;
+	plevel->member = NULL;
+	plevel->ngroup = 0;
+}
+
+static int
+is_residual(struct odflow *pflow)
+{
+	return ((pflow->byte != 0) || (pflow->packet != 0));
+}
+
+/* helper for qsort: compare the masked keys */
+static int
+entry_comp(const void *p0, const void *p1)
+{
+	const struct reduce_group *e0 = p0, *e1 = p1;
+
+	return memcmp(&e0->spec, &e1->spec, sizeof(struct odflow_spec));
+}
+
+/*
+ * helper for qsort: the order create_hh() visits the member flows in,
+ * the buckets of the list index by srclen and dstlen, then the list.
+ * a child task visits the parent cache, which is in the same order.
+ */
+static int
+member_comp(const void *p0, const void *p1)
+{
+	struct odflow *f0 = *(struct odflow **)p0;
+	struct odflow *f1 = *(struct odflow **)p1;
+
+	if (f0->spec.srclen != f1->spec.srclen)
+		return ((f0->spec.srclen < f1->spec.srclen) ? -1 : 1);
+	if (f0->spec.dstlen != f1->spec.dstlen)
+		return ((f0->spec.dstlen < f1->spec.dstlen) ? -1 : 1);
+	if (f0->list_index != f1->list_index)
+		return ((f0->list_index < f1->list_index) ? -1 : 1);
+	return (0);
+}
+
+/* helper for qsort: the order of the first member flows of the groups */
+static int
+heavy_comp(const void *p0, const void *p1)
+{
+	struct reduce_group *g0 = *(struct reduce_group **)p0;
+	struct reduce_group *g1 = *(struct reduce_group **)p1;
+
+	return (member_comp(&g0->member[0], &g1->member[0]));
+}
+
+/* helper for qsort: compare the masked keys, then the entry index */
+static int
+order_comp(const void *p0, const void *p1)
+{
+	const struct order_entry *e0 = p0, *e1 = p1;
+	int ret;
+
+	ret = memcmp(&e0->group.spec, &e1->group.spec,
+	    sizeof(struct odflow_spec));
+	if (ret != 0)
+		return (ret);
+	return ((e0->pos < e1->pos) ? -1 : (e0->pos > e1->pos));
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HHH_REDUCE_H
+#define HHH_REDUCE_H
+
+#include "../agurim_hhh.h"
+
+/* aggregates of a label, made of the member flows in a contiguous range */
+struct reduce_group {
+	struct odflow_spec spec;
+	struct odflow **member;
+	uint64_t nmember;
+	int64_t seed;		/* a member in the last interval, or -1 */
+};
+
+struct reduce_level {
+	struct reduce_group *group;
+	uint64_t ngroup;
+	struct odflow **member;	/* member flows ordered by group */
+	int parent;		/* index of the next-finer label, or -1 */
+	int nref;		/* number of labels derived from this level */
+};
+
+/*
+ * the key order of the last interval (incremental mode).
+ * rank[level][i] is the position of the group of the i-th flow of the
+ * last interval among the groups of the level, or RANK_NONE.
+ */
+struct reduce_seed {
+	int (*labels)[2];		/* the lattice of the ranks */
+	uint32_t nlabel;
+	struct odflow_spec *spec;	/* flows of the last interval */
+	uint64_t nspec;
+	int64_t *slot;			/* open addressing table to spec[] */
+	uint64_t nslot;			/* power of 2 */
+	uint32_t **rank;
+	uint32_t *nrank;
+
+	/* this interval, indexed by list_index */
+	int64_t *prev;			/* index in spec[], or -1 */
+	uint32_t **next_rank;
+	uint32_t *next_nrank;
+};
+
+#define RANK_NONE	UINT32_MAX
+
+struct reduce_lattice {
+	int (*labels)[2];
+	uint32_t nlabel;
+	uint32_t bytesize;
+	struct reduce_level *level;
+	struct reduce_seed *seed;	/* NULL if not incremental */
+};
+
+struct reduce_lattice *
+reduce_alloc(int (*labels)[2], uint32_t nlabel, uint32_t bytesize);
+void reduce_hh(struct hhh_task *ptask);
+int reduce_skip(struct hhh_task *ptask);
+void reduce_done(struct hhh_task *ptask);
+struct reduce_seed *
+reduce_seed(int af, int (*labels)[2], uint32_t nlabel,
+    struct odflow_list *plist);
+void reduce_seed_commit(int af, struct odflow_list *plist);
+
+#endif /* HHH_REDUCE_H */
@@ -0,0 +1,591 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../agurim_odflow.h"
+#include "../agurim_param.h"
+#include "hhh_sched.h"
+#include "hhh_task.h"
+#include "hhh_util.h"
+#include "hhh_reduce.h"
+#include "odflow_hash.h"
+#include "odflow_list.h"
+
+/*
+ * work-stealing execution of the HHH tasks.
+ *
+ * the labels of an address family have to be processed in order, but
+ * the child tasks of different aggregated flows work on disjoint flows,
+ * so that they run in parallel.  a task runs its children as jobs on
+ * the per-worker deques, and joins them by running (or stealing) other
+ * jobs.  a job is a refinement task followed by the clone task of the
+ * same flow, the order hhh_main() runs them in.
+ *
+ * the extracted flows are kept in per-job lists, and concatenated in the
+ * order hhh_main() would extract them, so that the output does not
+ * depend on the number of threads.
+ *
+ * the worker threads are created at the first call and kept in a pool
+ * for the later calls.  a worker without a job sleeps on the condition
+ * variable of the pool until a job is queued, a join completes or the
+ * run is over.
+ */
+
+#define SCHED_INITSIZE	64	/* initial deque size */
+#define OL_INITSIZE	16	/* initial output list size */
+
+struct sched_job {
+	struct hhh_task *ptask;		/* refinement or top-level task */
+	struct hhh_task *pclone;	/* clone task refreshed after ptask */
+	struct task_tailq *ptaskq;	/* top-level tasks of a chain */
+	struct odflow_list *output;
+	volatile int *pending;		/* counter of the joining task */
+};
+
+struct sched_deque {
+	pthread_mutex_t lock;
+	struct sched_job **job;
+	int head, tail, size;
+};
+
+struct sched_worker {
+	int id;
+	unsigned int seed;
+	struct odflow_hash *hash;	/* task hash owned by the worker */
+	struct sched_deque deque;
+	pthread_t thread;
+};
+
+struct sched_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;		/* a run starts or the state changes */
+	pthread_cond_t done;		/* the workers have left the run */
+	volatile uint64_t seq;		/* counter of the state changes */
+	uint64_t run;			/* counter of the runs */
+	int nbusy;			/* workers still in the run */
+	volatile int stop;		/* the run is over */
+	void (*func)(struct sched_worker *);
+};
+
+struct sched_foreach {
+	volatile uint64_t next;		/* index shared among the workers */
+	uint64_t n;
+	void (*func)(int, uint64_t, void *);
+	void *arg;
+};
+
+static struct sched_worker *workers;
+static int nworker;
+static struct sched_pool pool = {
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER, 0, 0, 0, 0, NULL
+};
+static struct sched_foreach foreach;
+
+static void pool_start(int nthread);
+static void pool_run(void (*func)(struct sched_worker *));
+static void pool_join(void);
+static void pool_wake(void);
+static void pool_wait(uint64_t seq);
+static void *worker_main(void *arg);
+static void steal_main(struct sched_worker *pw);
+static void foreach_main(struct sched_worker *pw);
+static void run_job(struct sched_worker *pw, struct sched_job *pjob);
+static void run_chain(struct sched_worker *pw, struct sched_job *pjob);
+static void
+run_task(struct sched_worker *pw, struct hhh_task *ptask, struct odflow_list *output);
+static void join_jobs(struct sched_worker *pw, volatile int *pending);
+static struct sched_job *find_job(struct sched_worker *pw);
+
+static void deque_init(struct sched_deque *pdeque);
+static void deque_push(struct sched_deque *pdeque, struct sched_job *pjob);
+static struct sched_job *deque_pop(struct sched_deque *pdeque);
+static struct sched_job *deque_steal(struct sched_deque *pdeque);
+
+static struct odflow_list *output_alloc(void);
+static void output_append(struct odflow_list *dst, struct odflow_list *src);
+
+void
+hhh_sched_main(struct task_tailq *ptaskq, int nthread)
+{
+	struct sched_job *chains;
+	struct task_tailq *pchainq;
+	struct hhh_task *ptask;
+	struct hhh_ctx *pctx;
+	volatile int pending;
+	int i, nchain;
+
+	/* split the task queue into chains of the same flow list */
+	chains  = calloc(ptaskq->ntask, sizeof(struct sched_job));
+	pchainq = calloc(ptaskq->ntask, sizeof(struct task_tailq));
+	if (ptaskq->ntask > 0 && (chains == NULL || pchainq == NULL))
+		goto err;
+	nchain = 0;
+	pctx = TAILQ_FIRST(&ptaskq->task_head)->ctx;
+	while ((ptask = TAILQ_FIRST(&ptaskq->task_head)) != NULL) {
+		TAILQ_REMOVE(&ptaskq->task_head, ptask, task_chain);
+		ptaskq->ntask--;
+		if (nchain == 0 ||
+		    TAILQ_LAST(&pchainq[nchain-1].task_head, taskq)->list != ptask->list) {
+			TAILQ_INIT(&pchainq[nchain].task_head);
+			pchainq[nchain].ntask = 0;
+			chains[nchain].ptaskq = &pchainq[nchain];
+			chains[nchain].output = output_alloc();
+			chains[nchain].pending = &pending;
+			nchain++;
+		}
+		TAILQ_INSERT_TAIL(&pchainq[nchain-1].task_head, ptask, task_chain);
+		pchainq[nchain-1].ntask++;
+	}
+
+	/* the calling thread is the worker 0 */
+	pool_start(nthread);
+	pending = nchain;
+	for (i = nchain - 1; i >= 0; i--)
+		deque_push(&workers[0].deque, &chains[i]);
+	pool_run(steal_main);
+	join_jobs(&workers[0], &pending);
+	pool_join();
+
+	for (i = 0; i < nchain; i++) {
+		output_append(pctx->agrflow_list, chains[i].output);
+		list_free(chains[i].output);
+	}
+	free(chains);
+	free(pchainq);
+	return;
+err:
+	fprintf(stderr, "%s: failed to start workers\n", __func__);
+	exit(1);
+}
+
+/*
+ * call func(worker, i, arg) for i in [0, n) on nthread threads.
+ * the calling thread is the worker 0.
+ */
+void
+sched_foreach(uint64_t n, int nthread,
+    void (*func)(int, uint64_t, void *), void *arg)
+{
+	pool_start(nthread);
+	foreach.next = 0;
+	foreach.n    = n;
+	foreach.func = func;
+	foreach.arg  = arg;
+	pool_run(foreach_main);
+	foreach_main(&workers[0]);
+	pool_join();
+}
+
+/* create the workers, or recreate them for another number of threads */
+static void
+pool_start(int nthread)
+{
+	int i;
+
+	if (nworker == nthread)
+		return;
+	if (nworker > 0) {
+		pthread_mutex_lock(&pool.lock);
+		pool.func = NULL;
+		pool.nbusy = nworker - 1;
+		pool.run++;
+		pthread_cond_broadcast(&pool.work);
+		pthread_mutex_unlock(&pool.lock);
+		for (i = 1; i < nworker; i++)
+			pthread_join(workers[i].thread, NULL);
+		for (i = 0; i < nworker; i++) {
+			hash_free(workers[i].hash);
+			free(workers[i].deque.job);
+			pthread_mutex_destroy(&workers[i].deque.lock);
+		}
+		free(workers);
+	}
+
+	nworker = nthread;
+	workers = calloc(nworker, sizeof(struct sched_worker));
+	if (workers == NULL)
+		goto err;
+	for (i = 0; i < nworker; i++) {
+		workers[i].id   = i;
+		workers[i].seed = i + 1;
+		workers[i].hash = hash_alloc();
+		if (workers[i].hash == NULL)
+			goto err;
+		deque_init(&workers[i].deque);
+	}
+	for (i = 1; i < nworker; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_main,
+		    &workers[i]) != 0)
+			goto err;
+	}
+	return;
+err:
+	fprintf(stderr, "%s: failed to start workers\n", __func__);
+	exit(1);
+}
+
+/* wake up the workers to run func until pool_join() */
+static void
+pool_run(void (*func)(struct sched_worker *))
+{
+	pthread_mutex_lock(&pool.lock);
+	pool.func = func;
+	__sync_lock_release(&pool.stop);
+	pool.nbusy = nworker - 1;
+	pool.run++;
+	__sync_fetch_and_add(&pool.seq, 1);
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/* end the run, and wait until all the workers have left it */
+static void
+pool_join(void)
+{
+	pthread_mutex_lock(&pool.lock);
+	__sync_lock_test_and_set(&pool.stop, 1);
+	__sync_fetch_and_add(&pool.seq, 1);
+	pthread_cond_broadcast(&pool.work);
+	while (pool.nbusy > 0)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/* wake up the sleeping workers after a state change */
+static void
+pool_wake(void)
+{
+	pthread_mutex_lock(&pool.lock);
+	__sync_fetch_and_add(&pool.seq, 1);
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/*
+ * sleep until the state changes after seq.  seq has to be read before
+ * looking for a job, so that a change in between is not lost.
+ */
+static void
+pool_wait(uint64_t seq)
+{
+	pthread_mutex_lock(&pool.lock);
+	while (__sync_fetch_and_add(&pool.seq, 0) == seq)
+		pthread_cond_wait(&pool.work, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+static void *
+worker_main(void *arg)
+{
+	struct sched_worker *pw = arg;
+	void (*func)(struct sched_worker *);
+	uint64_t run = 0;
+
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		while (pool.run == run)
+			pthread_cond_wait(&pool.work, &pool.lock);
+		run = pool.run;
+		func = pool.func;
+		pthread_mutex_unlock(&pool.lock);
+		if (func != NULL)
+			func(pw);
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.nbusy == 0)
+			pthread_cond_signal(&pool.done);
+		if (func == NULL)
+			break;
+	}
+	pthread_mutex_unlock(&pool.lock);
+	return NULL;
+}
+
+static void
+steal_main(struct sched_worker *pw)
+{
+	struct sched_job *pjob;
+	uint64_t seq;
+
+	for (;;) {
+		seq = __sync_fetch_and_add(&pool.seq, 0);
+		if ((pjob = find_job(pw)) != NULL) {
+			run_job(pw, pjob);
+			continue;
+		}
+		if (__sync_fetch_and_add(&pool.stop, 0))
+			break;
+		pool_wait(seq);
+	}
+}
+
+static void
+foreach_main(struct sched_worker *pw)
+{
+	uint64_t i;
+
+	while ((i = __sync_fetch_and_add(&foreach.next, 1)) < foreach.n)
+		foreach.func(pw->id, i, foreach.arg);
+}
+
+static void
+run_job(struct sched_worker *pw, struct sched_job *pjob)
+{
+	if (pjob->ptaskq != NULL) {
+		run_chain(pw, pjob);
+	} else {
+		if (pjob->ptask != NULL) {
+			run_task(pw, pjob->ptask, pjob->output);
+			task_free(pjob->ptask);
+		}
+		if (pjob->pclone != NULL) {
+			pjob->pclone->output = pjob->output;
+			refresh_hh(pjob->pclone);
+			task_free(pjob->pclone);
+		}
+	}
+	if (__sync_sub_and_fetch(pjob->pending, 1) == 0)
+		pool_wake();
+}
+
+/* the labels of a chain depend on the residuals of the previous labels */
+static void
+run_chain(struct sched_worker *pw, struct sched_job *pjob)
+{
+	struct hhh_task *ptask;
+
+	while ((ptask = TAILQ_FIRST(&pjob->ptaskq->task_head)) != NULL) {
+		TAILQ_REMOVE(&pjob->ptaskq->task_head, ptask, task_chain);
+		pjob->ptaskq->ntask--;
+		run_task(pw, ptask, pjob->output);
+		task_free(ptask);
+	}
+}
+
+/*
+ * run a task and its child tasks.
+ * the flows extracted by the task itself come first, then the flows of
+ * the child jobs in the order of the child task queue.
+ */
+static void
+run_task(struct sched_worker *pw, struct hhh_task *ptask, struct odflow_list *output)
+{
+	struct task_tailq childq;
+	struct hhh_task *pctask, *pnext;
+	struct sched_job *jobs;
+	volatile int pending;
+	int i, njob;
+
+	TAILQ_INIT(&childq.task_head);
+	childq.ntask = 0;
+
+	ptask->taskq_head = &childq;
+	ptask->hash = pw->hash;
+	ptask->output = output;
+	if (prune_hh(ptask))
+		return;
+	if (query.engine != HASH_ENGINE)
+		reduce_hh(ptask);
+	else
+		create_hh(ptask);
+	find_hh(ptask);
+
+	if (childq.ntask == 0)
+		return;
+
+	/* a refinement task is followed by the clone task of its flow */
+	jobs = calloc(childq.ntask, sizeof(struct sched_job));
+	if (jobs == NULL) {
+		fprintf(stderr, "%s: calloc failed\n", __func__);
+		exit(1);
+	}
+	njob = 0;
+	pctask = TAILQ_FIRST(&childq.task_head);
+	while (pctask != NULL) {
+		pnext = TAILQ_NEXT(pctask, task_chain);
+		if (pctask->done == 0) {
+			jobs[njob].ptask = pctask;
+			if ((pnext != NULL) && (pnext->done != 0) &&
+			    (pnext->orig_flow == pctask->orig_flow)) {
+				jobs[njob].pclone = pnext;
+				pnext = TAILQ_NEXT(pnext, task_chain);
+			}
+		} else {
+			jobs[njob].pclone = pctask;
+		}
+		jobs[njob].output = output_alloc();
+		jobs[njob].pending = &pending;
+		njob++;
+		pctask = pnext;
+	}
+
+	pending = njob;
+	for (i = njob - 1; i >= 0; i--)
+		deque_push(&pw->deque, &jobs[i]);
+	pool_wake();
+	join_jobs(pw, &pending);
+
+	for (i = 0; i < njob; i++) {
+		output_append(output, jobs[i].output);
+		list_free(jobs[i].output);
+	}
+	free(jobs);
+}
+
+/* run own or stolen jobs until the joined jobs complete */
+static void
+join_jobs(struct sched_worker *pw, volatile int *pending)
+{
+	struct sched_job *pjob;
+	uint64_t seq;
+
+	for (;;) {
+		seq = __sync_fetch_and_add(&pool.seq, 0);
+		if ((pjob = find_job(pw)) != NULL) {
+			run_job(pw, pjob);
+			continue;
+		}
+		if (__sync_fetch_and_add(pending, 0) == 0)
+			break;
+		pool_wait(seq);
+	}
+}
+
+static struct sched_job *
+find_job(struct sched_worker *pw)
+{
+	struct sched_job *pjob;
+	int i, victim;
+
+	if ((pjob = deque_pop(&pw->deque)) != NULL)
+		return pjob;
+	if (nworker < 2)
+		return NULL;
+	victim = rand_r(&pw->seed) % nworker;
+	for (i = 0; i < nworker; i++, victim = (victim + 1) % nworker) {
+		if (victim == pw->id)
+			continue;
+		if ((pjob = deque_steal(&workers[victim].deque)) != NULL)
+			return pjob;
+	}
+	return NULL;
+}
+
+static void
+deque_init(struct sched_deque *pdeque)
+{
+	pthread_mutex_init(&pdeque->lock, NULL);
+	pdeque->job = malloc(sizeof(struct sched_job *) * SCHED_INITSIZE);
+	if (pdeque->job == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	pdeque->size = SCHED_INITSIZE;
+	pdeque->head = pdeque->tail = 0;
+}
+
+/* the owner pushes and pops at the tail, thieves steal from the head */
+static void
+deque_push(struct sched_deque *pdeque, struct sched_job *pjob)
+{
+	pthread_mutex_lock(&pdeque->lock);
+	if (pdeque->tail == pdeque->size) {
+		if (pdeque->head > 0) {
+			memmove(pdeque->job, &pdeque->job[pdeque->head],
+			    sizeof(struct sched_job *) * (pdeque->tail - pdeque->head));
+			pdeque->tail -= pdeque->head;
+			pdeque->head = 0;
+		}
+		if (pdeque->tail == pdeque->size) {
+			pdeque->size *= 2;
+			pdeque->job = realloc(pdeque->job,
+			    sizeof(struct sched_job *) * pdeque->size);
+			if (pdeque->job == NULL) {
+				fprintf(stderr, "%s: realloc failed\n", __func__);
+				exit(1);
+			}
+		}
+	}
+	pdeque->job[pdeque->tail++] = pjob;
+	pthread_mutex_unlock(&pdeque->lock);
+}
+
+static struct sched_job *
+deque_pop(struct sched_deque *pdeque)
+{
+	struct sched_job *pjob = NULL;
+
+	pthread_mutex_lock(&pdeque->lock);
+	if (pdeque->tail > pdeque->head)
+		pjob = pdeque->job[--pdeque->tail];
+	if (pdeque->tail == pdeque->head)
+		pdeque->head = pdeque->tail = 0;
+	pthread_mutex_unlock(&pdeque->lock);
+	return pjob;
+}
+
+static struct sched_job *
+deque_steal(struct sched_deque *pdeque)
+{
+	struct sched_job *pjob = NULL;
+
+	pthread_mutex_lock(&pdeque->lock);
+	if (pdeque->tail > pdeque->head)
+		pjob = pdeque->job[pdeque->head++];
+	if (pdeque->tail == pdeque->head)
+		pdeque->head = pdeque->tail = 0;
+	pthread_mutex_unlock(&pdeque->lock);
+	return pjob;
+}
+
+static struct odflow_list *
+output_alloc(void)
+{
+	struct odflow_list *plist;
+
+	plist = list_alloc(OL_INITSIZE);
+	if (plist == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	return plist;
+}
+
+static void
+output_append(struct odflow_list *dst, struct odflow_list *src)
+{
+	uint64_t i;
+
+	for (i = 0; i < src->size; i++)
+		list_add(dst, src->list[i]);
+}
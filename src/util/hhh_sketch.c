@@ -0,0 +1,494 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../agurim_odflow.h"
+#include "../agurim_param.h"
+#include "hhh_sketch.h"
+#include "hhh_task.h"
+#include "hhh_util.h"
+#include "odflow_list.h"
+#include "proto_count.h"
+
+#define CL_INITSIZE	64	/* initial list size */
+
+/* the count the summaries are kept on */
+#define SK_COUNT(p)	((query.basis == PACKET) ? (p)->packet : (p)->byte)
+
+/*
+ * approximate HHH in bounded memory.
+ * each label of the lattice has a weighted Space-Saving summary of
+ * query.sketch_size counters, and every flow read by read_in() updates
+ * the counter of its prefix in each of them, instead of being kept in
+ * the hash.  when the summary is full, the smallest counter is taken
+ * over by the new prefix, which inherits the count as its error.
+ * each counter keeps a few subflow counters in the same way.
+ * the HHH walks the labels in the order of the tables, and a counter is
+ * extracted when its count less the counts of the extracted flows under
+ * it exceeds the threshold.
+ * the memory does not depend on the number of prefixes: it is
+ * (number of labels) * sketch_size * sizeof(struct sketch_entry).
+ */
+
+static struct sketch *v4_sketch;
+static struct sketch *v6_sketch;
+static struct sketch *proto_sketch;
+
+static struct sketch *sketch_get(int af);
+static struct sketch *
+sketch_alloc(int (*labels)[2], uint32_t nlabel, uint32_t bytesize);
+static void sketch_reset(struct sketch *psketch);
+static void
+sketch_update(struct sketch *psketch, struct odflow *pflow,
+    struct odflow *psubflow, uint64_t nsubflow);
+static struct sketch_entry *
+entry_find(struct sketch_level *plevel, struct odflow_spec *pspec, int af);
+static uint32_t calc_bucket(struct sketch_level *plevel, struct odflow_spec *pspec);
+static void heap_up(struct sketch_level *plevel, uint32_t pos);
+static void heap_down(struct sketch_level *plevel, uint32_t pos);
+static void heap_swap(struct sketch_level *plevel, uint32_t pos0, uint32_t pos1);
+static void subflow_update(struct sketch_entry *pentry, struct odflow *psubflow);
+static void
+sketch_extract(struct hhh_ctx *pctx, struct sketch *psketch);
+static struct odflow *
+entry_extract(struct sketch_entry *pentry, struct odflow_list *phh);
+static void
+entry_subflow(struct sketch_entry *pentry, struct odflow *pagrflow,
+    struct odflow_list *phh);
+
+/*
+ * count a flow record of read_in() with its subflows:
+ * the protocol specs in ADDR_VIEW, and the addresses in PROTO_VIEW.
+ */
+void
+sketch_addflow(struct odflow *pflow, struct odflow *pproto, uint64_t nproto)
+{
+	uint64_t i;
+
+	if (query.view == PROTO_VIEW) {
+		for (i = 0; i < nproto; i++) {
+			sketch_update(sketch_get(pproto[i].af), &pproto[i], pflow, 1);
+			param_update_total(pproto[i].byte, pproto[i].packet);
+		}
+	} else {
+		sketch_update(sketch_get(pflow->af), pflow, pproto, nproto);
+		param_update_total(pflow->byte, pflow->packet);
+	}
+}
+
+/*
+ * extract the aggregated flows from the summaries.  the summaries are
+ * kept for the other thresholds until sketch_clear().
+ */
+void
+sketch_hhh(struct hhh_ctx *pctx)
+{
+	if (v4_sketch != NULL)
+		sketch_extract(pctx, v4_sketch);
+	if (v6_sketch != NULL)
+		sketch_extract(pctx, v6_sketch);
+	if (proto_sketch != NULL)
+		sketch_extract(pctx, proto_sketch);
+}
+
+/* reset the summaries for the next interval */
+void
+sketch_clear(void)
+{
+	if (v4_sketch != NULL)
+		sketch_reset(v4_sketch);
+	if (v6_sketch != NULL)
+		sketch_reset(v6_sketch);
+	if (proto_sketch != NULL)
+		sketch_reset(proto_sketch);
+}
+
+/* the summaries are allocated on the first flow of the address family */
+static struct sketch *
+sketch_get(int af)
+{
+	struct sketch **ppsketch;
+	int (*labels)[2];
+	uint32_t nlabel, bytesize;
+
+	if (af == AF_INET) {
+		ppsketch = &v4_sketch;
+		nlabel = task_labels(af, &labels, &bytesize);
+	} else if (af == AF_INET6) {
+		ppsketch = &v6_sketch;
+		nlabel = task_labels(af, &labels, &bytesize);
+	} else {
+		ppsketch = &proto_sketch;
+		nlabel = pcount_labels(&labels);
+		bytesize = 3;
+	}
+	if (*ppsketch == NULL) {
+		*ppsketch = sketch_alloc(labels, nlabel, bytesize);
+		if (*ppsketch == NULL) {
+			fprintf(stderr, "%s: malloc failed\n", __func__);
+			exit(1);
+		}
+	}
+	return (*ppsketch);
+}
+
+static struct sketch *
+sketch_alloc(int (*labels)[2], uint32_t nlabel, uint32_t bytesize)
+{
+	struct sketch *psketch;
+	struct sketch_level *plevel;
+	uint32_t i, nentry = query.sketch_size;
+
+	psketch = calloc(1, sizeof(struct sketch));
+	if (psketch == NULL)
+		return NULL;
+	psketch->bytesize = bytesize;
+	psketch->nlevel = nlabel;
+	psketch->level = calloc(nlabel, sizeof(struct sketch_level));
+	if (psketch->level == NULL)
+		return NULL;
+	for (i = 0; i < nlabel; i++) {
+		plevel = &psketch->level[i];
+		plevel->label = labels[i];
+		for (plevel->nbucket = 1; plevel->nbucket < nentry * 2; )
+			plevel->nbucket <<= 1;
+		plevel->entry  = malloc(sizeof(struct sketch_entry) * nentry);
+		plevel->heap   = malloc(sizeof(uint32_t) * nentry);
+		plevel->bucket = malloc(sizeof(int32_t) * plevel->nbucket);
+		if (plevel->entry == NULL || plevel->heap == NULL ||
+		    plevel->bucket == NULL)
+			return NULL;
+	}
+	sketch_reset(psketch);
+	return (psketch);
+}
+
+static void
+sketch_reset(struct sketch *psketch)
+{
+	struct sketch_level *plevel;
+	uint32_t i;
+
+	for (i = 0; i < psketch->nlevel; i++) {
+		plevel = &psketch->level[i];
+		plevel->nentry = 0;
+		memset(plevel->bucket, 0xff, sizeof(int32_t) * plevel->nbucket);
+	}
+}
+
+static void
+sketch_update(struct sketch *psketch, struct odflow *pflow,
+    struct odflow *psubflow, uint64_t nsubflow)
+{
+	struct sketch_level *plevel;
+	struct sketch_entry *pentry;
+	struct odflow_spec spec;
+	uint32_t i, slot;
+	uint64_t j;
+	int32_t *pnext;
+
+	for (i = 0; i < psketch->nlevel; i++) {
+		plevel = &psketch->level[i];
+		if ((pflow->spec.srclen < plevel->label[0]) ||
+		    (pflow->spec.dstlen < plevel->label[1]))
+			continue;
+		spec = create_spec(&pflow->spec, plevel->label, psketch->bytesize);
+
+		pentry = entry_find(plevel, &spec, pflow->af);
+		if (pentry == NULL) {
+			if (plevel->nentry < query.sketch_size) {
+				/* a free counter */
+				pentry = &plevel->entry[plevel->nentry];
+				memset(pentry, 0, sizeof(struct sketch_entry));
+				pentry->heap = plevel->nentry;
+				plevel->heap[plevel->nentry++] = pentry - plevel->entry;
+				heap_up(plevel, pentry->heap);
+			} else {
+				/* take over the smallest counter */
+				pentry = &plevel->entry[plevel->heap[0]];
+				slot = calc_bucket(plevel, &pentry->spec);
+				pnext = &plevel->bucket[slot];
+				while (*pnext != pentry - plevel->entry)
+					pnext = &plevel->entry[*pnext].next;
+				*pnext = pentry->next;
+				pentry->err_byte   = pentry->byte;
+				pentry->err_packet = pentry->packet;
+				pentry->nsubflow = 0;
+			}
+			pentry->spec = spec;
+			pentry->af   = pflow->af;
+			slot = calc_bucket(plevel, &spec);
+			pentry->next = plevel->bucket[slot];
+			plevel->bucket[slot] = pentry - plevel->entry;
+		}
+		pentry->byte   += pflow->byte;
+		pentry->packet += pflow->packet;
+		heap_down(plevel, pentry->heap);
+
+		for (j = 0; j < nsubflow; j++)
+			subflow_update(pentry, &psubflow[j]);
+	}
+}
+
+static struct sketch_entry *
+entry_find(struct sketch_level *plevel, struct odflow_spec *pspec, int af)
+{
+	struct sketch_entry *pentry;
+	int32_t i;
+
+	for (i = plevel->bucket[calc_bucket(plevel, pspec)]; i >= 0;
+	    i = pentry->next) {
+		pentry = &plevel->entry[i];
+		if ((pentry->af == af) &&
+		    !memcmp(&pentry->spec, pspec, sizeof(struct odflow_spec)))
+			return (pentry);
+	}
+	return NULL;
+}
+
+/* multiplicative hash over the address words and the prefix lengths */
+static uint32_t
+calc_bucket(struct sketch_level *plevel, struct odflow_spec *pspec)
+{
+	uint32_t w[2 * MAXLEN / 4];
+	uint64_t h;
+	int i;
+
+	memcpy(w, pspec->src, sizeof(w));
+	h = (pspec->srclen << 8) | pspec->dstlen;
+	for (i = 0; i < 2 * MAXLEN / 4; i++)
+		h = (h ^ w[i]) * 0x9e3779b97f4a7c15ULL;
+	return ((h >> 32) & (plevel->nbucket - 1));
+}
+
+static void
+heap_up(struct sketch_level *plevel, uint32_t pos)
+{
+	uint32_t parent;
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (SK_COUNT(&plevel->entry[plevel->heap[parent]]) <=
+		    SK_COUNT(&plevel->entry[plevel->heap[pos]]))
+			break;
+		heap_swap(plevel, parent, pos);
+		pos = parent;
+	}
+}
+
+/* counts only increase, so that an updated counter moves down */
+static void
+heap_down(struct sketch_level *plevel, uint32_t pos)
+{
+	uint32_t child, n = plevel->nentry;
+
+	while ((child = pos * 2 + 1) < n) {
+		if ((child + 1 < n) &&
+		    (SK_COUNT(&plevel->entry[plevel->heap[child + 1]]) <
+		     SK_COUNT(&plevel->entry[plevel->heap[child]])))
+			child++;
+		if (SK_COUNT(&plevel->entry[plevel->heap[pos]]) <=
+		    SK_COUNT(&plevel->entry[plevel->heap[child]]))
+			break;
+		heap_swap(plevel, pos, child);
+		pos = child;
+	}
+}
+
+static void
+heap_swap(struct sketch_level *plevel, uint32_t pos0, uint32_t pos1)
+{
+	uint32_t tmp;
+
+	tmp = plevel->heap[pos0];
+	plevel->heap[pos0] = plevel->heap[pos1];
+	plevel->heap[pos1] = tmp;
+	plevel->entry[plevel->heap[pos0]].heap = pos0;
+	plevel->entry[plevel->heap[pos1]].heap = pos1;
+}
+
+/* a small Space-Saving summary of the subflows in the counter */
+static void
+subflow_update(struct sketch_entry *pentry, struct odflow *psubflow)
+{
+	struct sketch_subflow *psub, *pmin = NULL;
+	uint32_t i;
+
+	for (i = 0; i < pentry->nsubflow; i++) {
+		psub = &pentry->subflow[i];
+		if ((psub->af == psubflow->af) &&
+		    !memcmp(&psub->spec, &psubflow->spec, sizeof(struct odflow_spec)))
+			goto found;
+		if ((pmin == NULL) || (SK_COUNT(psub) < SK_COUNT(pmin)))
+			pmin = psub;
+	}
+	if (pentry->nsubflow < SK_NSUBFLOW) {
+		psub = &pentry->subflow[pentry->nsubflow++];
+		psub->byte   = 0;
+		psub->packet = 0;
+	} else
+		psub = pmin;
+	psub->spec = psubflow->spec;
+	psub->af   = psubflow->af;
+found:
+	psub->byte   += psubflow->byte;
+	psub->packet += psubflow->packet;
+}
+
+/*
+ * the labels are visited in the order of the tables, so that the flows
+ * extracted under a counter have been extracted before it.
+ */
+static void
+sketch_extract(struct hhh_ctx *pctx, struct sketch *psketch)
+{
+	struct sketch_level *plevel;
+	struct sketch_entry *pentry;
+	struct odflow_list *phh;
+	struct odflow *pagrflow, hh;
+	uint32_t i, j;
+
+	phh = list_alloc(CL_INITSIZE);
+	if (phh == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	for (i = 0; i < psketch->nlevel; i++) {
+		plevel = &psketch->level[i];
+		for (j = 0; j < plevel->nentry; j++) {
+			pentry = &plevel->entry[j];
+			/* the count is the upper bound of the residual */
+			hh.byte   = pentry->byte;
+			hh.packet = pentry->packet;
+			if (!check_thresh(pctx, &hh))
+				continue;
+			pagrflow = entry_extract(pentry, phh);
+			if (!check_thresh(pctx, pagrflow)) {
+				odflow_free(pagrflow);
+				continue;
+			}
+			entry_subflow(pentry, pagrflow, phh);
+			list_add(phh, pagrflow);
+			extract_hh(pctx, NULL, pagrflow);
+		}
+	}
+	list_free(phh);
+}
+
+/*
+ * make a flow of the counter less the extracted flows under it.
+ * as the counts of the extracted flows are also estimated, their
+ * errors are added to the error of the counter.
+ */
+static struct odflow *
+entry_extract(struct sketch_entry *pentry, struct odflow_list *phh)
+{
+	struct odflow *pagrflow, *phhflow;
+	uint64_t i;
+
+	pagrflow = odflow_alloc();
+	if (pagrflow == NULL)
+		goto err;
+	pagrflow->err = malloc(sizeof(struct odflow_err));
+	if (pagrflow->err == NULL)
+		goto err;
+	pagrflow->spec   = pentry->spec;
+	pagrflow->af     = pentry->af;
+	pagrflow->byte   = pentry->byte;
+	pagrflow->packet = pentry->packet;
+	pagrflow->err->byte   = pentry->err_byte;
+	pagrflow->err->packet = pentry->err_packet;
+	for (i = 0; i < phh->size; i++) {
+		phhflow = phh->list[i];
+		if (!is_overlapped(pagrflow, phhflow))
+			continue;
+		pagrflow->byte   -= min(pagrflow->byte, phhflow->byte);
+		pagrflow->packet -= min(pagrflow->packet, phhflow->packet);
+		pagrflow->err->byte   += phhflow->err->byte;
+		pagrflow->err->packet += phhflow->err->packet;
+	}
+	return (pagrflow);
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+/* the subflows of the counter less those of the extracted flows under it */
+static void
+entry_subflow(struct sketch_entry *pentry, struct odflow *pagrflow,
+    struct odflow_list *phh)
+{
+	struct odflow *phhflow, *psubflow, *phhsubflow;
+	struct sketch_subflow *psub;
+	uint64_t i, j, k;
+
+	for (j = 0; j < pentry->nsubflow; j++) {
+		psub = &pentry->subflow[j];
+		psubflow = odflow_alloc();
+		if (psubflow == NULL)
+			goto err;
+		psubflow->spec   = psub->spec;
+		psubflow->af     = psub->af;
+		psubflow->byte   = psub->byte;
+		psubflow->packet = psub->packet;
+		for (i = 0; i < phh->size; i++) {
+			phhflow = phh->list[i];
+			if ((phhflow->subflow == NULL) ||
+			    !is_overlapped(pagrflow, phhflow))
+				continue;
+			for (k = 0; k < phhflow->subflow->size; k++) {
+				phhsubflow = phhflow->subflow->list[k];
+				if (memcmp(&phhsubflow->spec, &psubflow->spec,
+				    sizeof(struct odflow_spec)))
+					continue;
+				psubflow->byte -= min(psubflow->byte,
+				    phhsubflow->byte);
+				psubflow->packet -= min(psubflow->packet,
+				    phhsubflow->packet);
+			}
+		}
+		if ((psubflow->byte == 0) && (psubflow->packet == 0)) {
+			odflow_free(psubflow);
+			continue;
+		}
+		if (pagrflow->subflow == NULL &&
+		    (pagrflow->subflow = list_alloc(SK_NSUBFLOW)) == NULL)
+			goto err;
+		list_add(pagrflow->subflow, psubflow);
+	}
+	return;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HHH_SKETCH_H
+#define HHH_SKETCH_H
+
+#include "../agurim_hhh.h"
+
+#define SK_NENTRY	1024	/* default number of counters for a label */
+#define SK_NSUBFLOW	8	/* number of subflow counters for a counter */
+
+struct sketch_subflow {
+	struct odflow_spec spec;
+	int af;
+	uint64_t byte;
+	uint64_t packet;
+};
+
+/* a Space-Saving counter; err is the count inherited on replacement */
+struct sketch_entry {
+	struct odflow_spec spec;
+	int af;
+	uint64_t byte, packet;
+	uint64_t err_byte, err_packet;
+	int32_t next;		/* hash chain */
+	uint32_t heap;		/* position in the heap */
+	uint32_t nsubflow;
+	struct sketch_subflow subflow[SK_NSUBFLOW];
+};
+
+/* a Space-Saving summary for a label */
+struct sketch_level {
+	int *label;
+	struct sketch_entry *entry;
+	uint32_t nentry;
+	uint32_t *heap;		/* min-heap of the entries on the count */
+	int32_t *bucket;
+	uint32_t nbucket;
+};
+
+struct sketch {
+	uint32_t bytesize;
+	uint32_t nlevel;
+	struct sketch_level *level;
+};
+
+void
+sketch_addflow(struct odflow *pflow, struct odflow *pproto, uint64_t nproto);
+void sketch_hhh(struct hhh_ctx *pctx);
+void sketch_clear(void);
+
+#endif /* HHH_SKETCH_H */
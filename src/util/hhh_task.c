@@ -34,8 +34,10 @@
 #include <string.h>
 
 #include "hhh_task.h"
+#include "hhh_util.h"
 #include "odflow_list.h"
 #include "odflow_hash.h"
+#include "hhh_reduce.h"
 #include "../agurim_odflow.h"
 #include "../agurim_param.h"
 
@@ -70,22 +72,37 @@ static int ipv6_labels[39][2] = {
   {48,0},{0,48},{32,16},{16,32},{32,0},{0,32},{16,16},{16,0},{0,16},{0,0}
 };
 
-static int proto_labels[5][2] = {
-  {24,24},{24,8},{8,24},{8,8},{0,0}
+/* IPv6 all 81 combinations for LATTICE_EXACT and LATTICE_AUTO */
+static int ipv6_exact_labels[81][2] = {
+  {128,128},{128,112},{112,128},{128,96},{96,128},{112,112},
+  {128,80},{80,128},{112,96},{96,112},
+  {128,64},{64,128},{112,80},{80,112},{96,96},
+  {128,48},{48,128},{112,64},{64,112},{96,80},{80,96},
+  {128,32},{32,128},{112,48},{48,112},{96,64},{64,96},{80,80},
+  {128,16},{16,128},{112,32},{32,112},{96,48},{48,96},{80,64},{64,80},
+  {128,0},{0,128},{112,16},{16,112},{96,32},{32,96},{80,48},{48,80},{64,64},
+  {112,0},{0,112},{96,16},{16,96},{80,32},{32,80},{64,48},{48,64},
+  {96,0},{0,96},{80,16},{16,80},{64,32},{32,64},{48,48},
+  {80,0},{0,80},{64,16},{16,64},{48,32},{32,48},
+  {64,0},{0,64},{48,16},{16,48},{32,32},
+  {48,0},{0,48},{32,16},{16,32},{32,0},{0,32},{16,16},{16,0},{0,16},{0,0}
 };
-static void
-order_list(struct odflow_hash *phash, struct odflow_list *plist);
-static int hhh_comp(const void *p0, const void *p1);
 
-static int is_label(struct odflow_spec *pspec, int *label);
+static struct list_index *
+order_list(struct odflow_hash *phash, struct odflow_list *plist, uint32_t maxlen);
+static struct list_index *index_alloc(uint32_t maxlen);
+static void index_free(struct list_index *pindex);
+static uint64_t index_end(struct list_index *pindex, int *label);
+static uint32_t index_labels(struct list_index *pindex,
+    int (*labels)[2], uint32_t nlabel);
+static int index_covers(struct list_index *pindex, int *label);
+static int check_residual(struct hhh_ctx *pctx, struct odflow *pflow);
+
 static int
 get_child_bitsize(struct hhh_task *ptask);
 static void
 set_child_label(struct hhh_task *ptask, struct hhh_task *pctask, struct odflow_spec *pspec);
 
-static int
-binsearch(struct odflow **plist, int *label, int start, int end);
-
 /* 
  * NOTE: this API never release hash space 
  *       in order to make the data processing time short
@@ -123,6 +140,19 @@ err:
 void
 task_free(struct hhh_task *ptask)
 {
+	int i;
+
+	if ((ptask->index != NULL) && (--ptask->index->nref == 0)) {
+		for (i = 0; i < 2; i++) {
+			if (ptask->ctx->index[i] == ptask->index)
+				ptask->ctx->index[i] = NULL;
+		}
+		index_free(ptask->index);
+	}
+	/* the aggregates of the task are done with their member flows */
+	if (ptask->lattice != NULL)
+		reduce_done(ptask);
+	free(ptask->member);
 	if (ptask->orig_flow != NULL) {
 		free(ptask->label);
 		//list_free(ptask->list);
@@ -146,46 +176,75 @@ task_free(struct hhh_task *ptask)
 	free(ptask);
 }
 
+/*
+ * the label table and the byte size of the address family.
+ * the IPv4 table has all the combinations in any lattice.
+ */
+uint32_t
+task_labels(int af, int (**plabels)[2], uint32_t *pbytesize)
+{
+	if (af == AF_INET) {
+		*plabels = ipv4_labels;
+		*pbytesize = 8;
+		return (sizeof(ipv4_labels)/sizeof(int)/2);
+	}
+	*pbytesize = 16;
+	if (query.lattice != LATTICE_FAST) {
+		*plabels = ipv6_exact_labels;
+		return (sizeof(ipv6_exact_labels)/sizeof(int)/2);
+	}
+	*plabels = ipv6_labels;
+	return (sizeof(ipv6_labels)/sizeof(int)/2);
+}
+
 struct odflow_list *
-taskq_create(struct task_tailq *ptaskq, int af)
+taskq_create(struct task_tailq *ptaskq, struct hhh_ctx *pctx, int af)
 {
 	struct odflow_list *plist;
 	struct odflow_hash *phash;
 	struct hhh_task *ptask;
+	struct list_index *pindex;
+	struct reduce_lattice *plattice = NULL;
 	int (*plabels)[2];
 	uint32_t i, len;
 	uint32_t bytesize;
 	uint64_t nflow;
 
-	if (af == AF_INET) {
-		phash = ip_hash;
-		nflow = ip_hash->nrecord;
-		plabels = ipv4_labels;
-		len = sizeof(ipv4_labels)/sizeof(int)/2;
-		bytesize = 8;
-	} else if (af == AF_INET6) {
-		phash = ip6_hash;
-		nflow = ip6_hash->nrecord;
-		plabels = ipv6_labels;
-		len = sizeof(ipv6_labels)/sizeof(int)/2;
-		bytesize = 16;
-	} else {
-		phash = proto_hash;
-		nflow = proto_hash->nrecord;
-		plabels = proto_labels;
-		len = sizeof(proto_labels)/sizeof(int)/2;
-		bytesize = 3;
-	}
+	/* NOTE: protocol specs are aggregated by proto_hhh() */
+	phash = (af == AF_INET) ? pctx->ip_hash : pctx->ip6_hash;
+	nflow = phash->nrecord;
+	len = task_labels(af, &plabels, &bytesize);
 
 	/* No task needs to append, thus, return immediately */
 	if (nflow == 0)
 		return NULL;
 
 	plist = list_alloc(nflow);
-	order_list(phash, plist);
+	pindex = order_list(phash, plist, bytesize * 8);
+	if (pindex == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	/* extract_hh() takes the extracted flows off the residual mass */
+	pctx->index[(af == AF_INET) ? 0 : 1] = pindex;
+	if (query.lattice == LATTICE_AUTO) {
+		len = index_labels(pindex, plabels, len);
+		plabels = pindex->labels;
+	}
+	if (query.engine != HASH_ENGINE) {
+		plattice = reduce_alloc(plabels, len, bytesize);
+		if (plattice == NULL) {
+			fprintf(stderr, "%s: malloc failed\n", __func__);
+			exit(1);
+		}
+		/* the main HHH is seeded with the previous interval */
+		if (query.incremental && pctx->mode == HHH_MAIN_MODE)
+			plattice->seed = reduce_seed(af, plabels, len, plist);
+	}
 	for (i = 0; i < len; i++) {
 		ptask = task_alloc(TASK_FLG_NONE);
 
+		ptask->ctx      = pctx;
 		ptask->label    = &plabels[i][0];
 		ptask->bytesize = bytesize;
 		ptask->bitsize  = 0;
@@ -193,10 +252,15 @@ taskq_create(struct task_tailq *ptaskq, int af)
 		ptask->hash = phash;
 
 		ptask->list = plist;
-		ptask->end  = (uint64_t)binsearch(ptask->list->list, plabels[i], 0, nflow);
+		ptask->end  = index_end(pindex, plabels[i]);
+		ptask->index = pindex;
+		pindex->nref++;
 
 		ptask->orig_flow = NULL;
 
+		ptask->lattice = plattice;
+		ptask->level   = i;
+
 		ptask->done = 0;
 		ptask->taskq_head = ptaskq;
 		
@@ -215,6 +279,7 @@ add_child_task(struct hhh_task *ptask, struct odflow *pflow)
 	if (ptask->bitsize == 0){
 		/* clone the aggregated flow */
 		pctask = task_alloc(TASK_FLG_LABEL);
+		pctask->ctx = ptask->ctx;
 		pctask->bitsize = 0;
 		pctask->bytesize = ptask->bytesize;
 		pctask->label[0] = ptask->label[0];
@@ -229,9 +294,18 @@ add_child_task(struct hhh_task *ptask, struct odflow *pflow)
 		ptask->taskq_head->ntask++; 
 	}
 
+	/*
+	 * the flows extracted by the previous child tasks are zero.
+	 * no subset of the rest can pass the threshold if all of them
+	 * cannot, and the refinement would extract nothing.
+	 */
+	if (ptask->bitsize != 0 && !check_residual(ptask->ctx, pflow))
+		return;
+
 	pctask_bitsize = get_child_bitsize(ptask);
 	if ((pflow->cache->size > 1) && (pctask_bitsize > 0)) {
 		pctask = task_alloc(TASK_FLG_LABEL);
+		pctask->ctx = ptask->ctx;
 		pctask->orig_flow = pflow;
 
 		pctask->hash = ptask->hash;
@@ -250,75 +324,192 @@ add_child_task(struct hhh_task *ptask, struct odflow *pflow)
 	}
 }
 
-static void
-order_list(struct odflow_hash *phash, struct odflow_list *plist)
+/*
+ * move the flows in the hash to the list, ordered by the sum of the
+ * prefix lengths, srclen and dstlen (all in descending order).
+ * a counting sort by the prefix length pair replaces qsort(), and the
+ * resulting bucket offsets give the exact range of each label.
+ */
+static struct list_index *
+order_list(struct odflow_hash *phash, struct odflow_list *plist, uint32_t maxlen)
 {
-	struct odf_tailq *ptailq;
+	struct list_index *pindex;
 	struct odflow *pflow;
-	uint64_t i;
+	struct odflow **unsorted;
+	uint64_t i, off, slot;
+	int sum, s;
 
-	for (i = 0; i < NBUCKETS; i++) {
-		if (phash->nrecord == 0)
-			break;
-		ptailq = &phash->tbl[i];
-		phash->nrecord -= ptailq->nrecord;
-		while ((pflow = TAILQ_FIRST(&ptailq->odfq_head)) != NULL) {
-			TAILQ_REMOVE(&ptailq->odfq_head, pflow, odf_chain);
-			ptailq->nrecord--;
-			plist->list[plist->size] = pflow;
-			pflow->list_index = plist->size++;
+	pindex = index_alloc(maxlen);
+	if (pindex == NULL)
+		return NULL;
+
+	/* count flows for each prefix length pair */
+	while ((pflow = hash_pop(phash)) != NULL) {
+		plist->list[plist->size++] = pflow;
+		slot = INDEX_SLOT(pindex, min(pflow->spec.srclen, maxlen),
+		    min(pflow->spec.dstlen, maxlen));
+		pindex->count[slot]++;
+		pindex->byte[slot]   += pflow->byte;
+		pindex->packet[slot] += pflow->packet;
+	}
+	pindex->nflow = plist->size;
+
+	/* bucket offsets in the order of the labels */
+	off = 0;
+	for (sum = maxlen * 2; sum >= 0; sum--) {
+		for (s = min(sum, (int)maxlen); s >= max(0, sum - (int)maxlen); s--) {
+			slot = INDEX_SLOT(pindex, s, sum - s);
+			pindex->start[slot] = off;
+			off += pindex->count[slot];
+			if (pindex->count[slot] > 0)
+				pindex->slot[pindex->nslot++] = slot;
+			pindex->count[slot] = 0;
 		}
 	}
-        qsort(plist->list, plist->size, sizeof(struct odflow *), hhh_comp);
-#if 0
+
+	/* scatter the flows into their buckets */
+	unsorted = plist->list;
+	plist->list = malloc(sizeof(struct odflow *) * plist->max_size);
+	if (plist->list == NULL) {
+		plist->list = unsorted;
+		index_free(pindex);
+		return NULL;
+	}
 	for (i = 0; i < plist->size; i++) {
-		pflow = plist->list[i];
-		printf("[%ld] ", i);
-		odflow_print(pflow);
-		printf("\n");
-		//printf(" %d %d ", pflow->spec.srclen, pflow->spec.dstlen);
+		pflow = unsorted[i];
+		slot = INDEX_SLOT(pindex, min(pflow->spec.srclen, maxlen),
+		    min(pflow->spec.dstlen, maxlen));
+		off = pindex->start[slot] + pindex->count[slot]++;
+		plist->list[off] = pflow;
+		pflow->list_index = off;
 	}
-#endif
+	free(unsorted);
+	return pindex;
 }
 
-/* helper for qsort: compare the sum of prefix length */
+static struct list_index *
+index_alloc(uint32_t maxlen)
+{
+	struct list_index *pindex;
+	uint64_t nslot = (maxlen + 1) * (maxlen + 1);
+
+	pindex = calloc(1, sizeof(struct list_index));
+	if (pindex == NULL)
+		return NULL;
+	pindex->maxlen = maxlen;
+	pindex->start = calloc(nslot, sizeof(uint64_t));
+	pindex->count = calloc(nslot, sizeof(uint64_t));
+	pindex->byte   = calloc(nslot, sizeof(uint64_t));
+	pindex->packet = calloc(nslot, sizeof(uint64_t));
+	pindex->slot   = malloc(sizeof(uint64_t) * nslot);
+	if (pindex->start == NULL || pindex->count == NULL ||
+	    pindex->byte == NULL || pindex->packet == NULL ||
+	    pindex->slot == NULL) {
+		index_free(pindex);
+		return NULL;
+	}
+	return pindex;
+}
+
+static void
+index_free(struct list_index *pindex)
+{
+	free(pindex->start);
+	free(pindex->count);
+	free(pindex->byte);
+	free(pindex->packet);
+	free(pindex->slot);
+	free(pindex->labels);
+	free(pindex);
+}
+
+/*
+ * keep the labels covering any flow of the list in pindex->labels.
+ * an empty label extracts nothing, and the labels derived from it in
+ * the sort-and-reduce engine derive from the next finer label instead.
+ */
+static uint32_t
+index_labels(struct list_index *pindex, int (*labels)[2], uint32_t nlabel)
+{
+	uint32_t i, n;
+
+	pindex->labels = malloc(sizeof(int) * 2 * nlabel);
+	if (pindex->labels == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	for (i = 0, n = 0; i < nlabel; i++) {
+		if (!index_covers(pindex, labels[i]))
+			continue;
+		pindex->labels[n][0] = labels[i][0];
+		pindex->labels[n][1] = labels[i][1];
+		n++;
+	}
+	return n;
+}
+
+/* whether any flow has the prefix lengths covered by the label */
 static int
-hhh_comp(const void *p0, const void *p1)
+index_covers(struct list_index *pindex, int *label)
 {
-	struct odflow *e0, *e1;
-	uint16_t len0, len1;
-
-	e0 = *(struct odflow **)p0;
-	e1 = *(struct odflow **)p1;
-
-	len0 = e0->spec.srclen + e0->spec.dstlen;
-	len1 = e1->spec.srclen + e1->spec.dstlen;
-
-	if (len0 < len1)
-		return (1);
-	else if (len0 > len1)
-		return (-1);
-	else {
-		if (e0->spec.srclen < e1->spec.srclen)
-			return (1);
-		else if (e0->spec.srclen > e1->spec.srclen)
-			return (-1);
-		else if (e0->spec.dstlen < e1->spec.dstlen)
-			return (1);
-		else if (e0->spec.dstlen > e1->spec.dstlen)
-			return (-1);
+	uint64_t i, slot;
+
+	for (i = 0; i < pindex->nslot; i++) {
+		slot = pindex->slot[i];
+		if (INDEX_SRCLEN(pindex, slot) >= (uint32_t)label[0] &&
+		    INDEX_DSTLEN(pindex, slot) >= (uint32_t)label[1])
+			return 1;
 	}
-	return (0);
+	return 0;
 }
 
+/* the residual mass of the flows covered by the label */
+void
+index_residual(struct list_index *pindex, int *label, struct odflow *phh)
+{
+	uint64_t i, slot;
+
+	phh->byte = 0;
+	phh->packet = 0;
+	for (i = 0; i < pindex->nslot; i++) {
+		slot = pindex->slot[i];
+		if (INDEX_SRCLEN(pindex, slot) < (uint32_t)label[0] ||
+		    INDEX_DSTLEN(pindex, slot) < (uint32_t)label[1])
+			continue;
+		phh->byte   += pindex->byte[slot];
+		phh->packet += pindex->packet[slot];
+	}
+}
+
+/* whether the residual mass of the member flows passes the threshold */
 static int
-is_label(struct odflow_spec *pspec, int *label)
+check_residual(struct hhh_ctx *pctx, struct odflow *pflow)
 {
-	int sum = pspec->srclen + pspec->dstlen;
-	int label_sum = label[0] + label[1];
-	return (sum - label_sum);
+	struct odflow hh;
+	uint64_t i;
+
+	hh.byte = 0;
+	hh.packet = 0;
+	for (i = 0; i < pflow->cache->size; i++) {
+		hh.byte   += pflow->cache->list[i]->byte;
+		hh.packet += pflow->cache->list[i]->packet;
+	}
+	return (check_thresh(pctx, &hh));
 }
 
+/* the number of flows whose prefix length sum is not less than the label's */
+static uint64_t
+index_end(struct list_index *pindex, int *label)
+{
+	int sum = label[0] + label[1] - 1;
+	int s;
+
+	if (sum < 0)
+		return pindex->nflow;
+	/* the first bucket of the next smaller sum starts at the end */
+	s = min(sum, (int)pindex->maxlen);
+	return pindex->start[INDEX_SLOT(pindex, s, sum - s)];
+}
 static int
 get_child_bitsize(struct hhh_task *ptask)
 {
@@ -348,7 +539,6 @@ set_child_label(struct hhh_task *ptask, struct hhh_task *pctask, struct odflow_s
 	int diff;
 
 	diff = (int)pctask->bitsize - (int)ptask->bitsize;
-	printf("XXX dif=%d caled(%d)\n", diff, pspec->srclen + diff);
 	if (max_bitsize > sum) {
 #if 0
 		if (pspec->srclen < pspec->dstlen){
@@ -386,67 +576,3 @@ set_child_label(struct hhh_task *ptask, struct hhh_task *pctask, struct odflow_s
 		}
 	}
 }
-
-
-static int
-binsearch(struct odflow **plist, int *label, int start, int end)
-{
-	struct odflow *pflow = NULL;
-	int saved_end = end;
-	int mid;
-	uint16_t len;
-	int flg;
-	uint16_t sum = label[0] + label[1];
-
-	if (end == 0)	return end;
-
-	/* find a corresponding position of the label */
-	mid = (start + end) / 2;
-	while (end - start > 1){
-		pflow = plist[mid];
-		len = pflow->spec.srclen + pflow->spec.dstlen;
-		if (len < sum)
-			end = mid;
-		else if (len > sum)
-			start = mid; 
-		else if (pflow->spec.srclen < label[0])
-			end = mid;
-		else if (pflow->spec.srclen > label[0])
-			start = mid; 
-		else if (pflow->spec.dstlen < label[1])
-			end = mid;
-		else if (pflow->spec.dstlen > label[1])
-			start = mid; 
-		else
-			break;
-		mid = (start + end) / 2;
-	}
-	if (pflow == NULL)
-		pflow = plist[mid];
-
-	/* find start position of the label if label exists */
-	flg = is_label(&pflow->spec, label);
-	if (flg > 0){
-		while ((mid >= 0) && (mid < saved_end)) {
-			pflow = plist[mid];
-			if (is_label(&pflow->spec, label) <= 0)
-				break; 
-			mid++;
-		}
-	} else if (flg == 0) {
-		while ((mid >= 0) && (mid < saved_end)) {
-			pflow = plist[mid];
-			if (is_label(&pflow->spec, label) < 0)
-				break; 
-			mid++;
-		}
-	} else {
-		while ((mid > 0) && (mid < saved_end)) {
-			pflow = plist[mid];
-			if (is_label(&pflow->spec, label) >= 0)
-				break; 
-			mid--;
-		}
-	}
-	return mid;
-}
@@ -36,12 +36,37 @@
 #define TASK_FLG_LABEL	1
 #define TASK_FLG_LIST	2
 
+/*
+ * flows of a task list ordered by (srclen, dstlen).
+ * the flows of a prefix length pair are in
+ * list[start[slot]] .. list[start[slot] + count[slot] - 1].
+ */
+struct list_index {
+	uint32_t maxlen;	/* 32 for IPv4, 128 for IPv6 */
+	uint64_t nflow;
+	uint64_t *start;
+	uint64_t *count;
+	uint64_t *byte;		/* residual mass of the flows in a slot */
+	uint64_t *packet;
+	uint64_t *slot;		/* the slots having flows, in list order */
+	uint64_t nslot;
+	int (*labels)[2];	/* the labels covering flows (LATTICE_AUTO) */
+	int nref;		/* number of tasks sharing this index */
+};
+
+#define INDEX_SLOT(pindex, srclen, dstlen) \
+	((srclen) * ((pindex)->maxlen + 1) + (dstlen))
+#define INDEX_SRCLEN(pindex, slot)	((slot) / ((pindex)->maxlen + 1))
+#define INDEX_DSTLEN(pindex, slot)	((slot) % ((pindex)->maxlen + 1))
+
 struct hhh_task *
 task_alloc(uint8_t alloc_flg);
 void task_free(struct hhh_task *ptask);
 
+uint32_t task_labels(int af, int (**plabels)[2], uint32_t *pbytesize);
 struct odflow_list *
-taskq_create(struct task_tailq *ptaskq, int af);
+taskq_create(struct task_tailq *ptaskq, struct hhh_ctx *pctx, int af);
 void add_child_task(struct hhh_task *ptask, struct odflow *pflow);
+void index_residual(struct list_index *pindex, int *label, struct odflow *phh);
 
 #endif /* HHH_TASK_H */
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../agurim_odflow.h"
+#include "../agurim_param.h"
+#include "hhh_trie.h"
+#include "hhh_util.h"
+#include "odflow_hash.h"
+#include "odflow_list.h"
+
+#define TN_INITSIZE	256	/* initial node array size */
+#define CL_INITSIZE	64	/* initial cache size */
+
+/*
+ * HHH on a two-dimensional prefix trie at bit granularity.
+ * the source trie is walked from the root, and a source prefix is
+ * split by the next bit only while it has enough traffic for a heavy
+ * hitter.  the flows of each source prefix are kept in the order of
+ * the destination address, so the destination trie under it is walked
+ * on ranges of the same array.
+ * the frequent (srclen, dstlen) nodes are then visited bottom-up in the
+ * order of the label tables (the sum of the prefix lengths, then the
+ * source prefix length), and a node is extracted when the counts of
+ * its flows not yet extracted exceed the threshold.
+ */
+
+static void drain_hash(struct odflow_hash *phash, struct odflow_list *plist);
+static int dst_comp(const void *p0, const void *p1);
+static int node_comp(const void *p0, const void *p1);
+static int bit_test(uint8_t *addr, uint32_t len);
+static int
+is_frequent(struct hhh_trie *ptrie, struct odflow **flow,
+    uint64_t lo, uint64_t hi, uint32_t srclen, uint32_t dstlen);
+static void
+src_walk(struct hhh_trie *ptrie, struct odflow **flow, uint64_t n,
+    uint32_t srclen, int shared);
+static void
+dst_walk(struct hhh_trie *ptrie, uint32_t snode, uint64_t lo, uint64_t hi,
+    uint32_t dstlen);
+static void extract_node(struct hhh_trie *ptrie, struct trie_node *pnode);
+static void trie_free(struct hhh_trie *ptrie);
+
+/*
+ * flows in the hash of the address family are moved to the returned
+ * list, which is freed by the caller in the same way as the list made
+ * by taskq_create().
+ */
+struct odflow_list *
+trie_hhh(struct hhh_ctx *pctx, int af)
+{
+	struct hhh_trie trie;
+	struct odflow_hash *phash;
+	struct odflow_list *plist;
+	struct odflow **flow;
+	uint64_t i, n;
+
+	phash = (af == AF_INET) ? pctx->ip_hash : pctx->ip6_hash;
+	if (phash->nrecord == 0)
+		return NULL;
+
+	memset(&trie, 0, sizeof(struct hhh_trie));
+	trie.ctx      = pctx;
+	trie.maxlen   = (af == AF_INET) ? 32 : 128;
+	trie.bytesize = (af == AF_INET) ? 8 : 16;
+
+	plist = list_alloc(phash->nrecord);
+	drain_hash(phash, plist);
+
+	/* the root of the source trie holds all the flows */
+	flow = malloc(sizeof(struct odflow *) * plist->size);
+	if (flow == NULL)
+		goto err;
+	n = 0;
+	for (i = 0; i < plist->size; i++) {
+		if ((plist->list[i]->byte == 0) && (plist->list[i]->packet == 0))
+			continue;
+		flow[n++] = plist->list[i];
+	}
+	qsort(flow, n, sizeof(struct odflow *), dst_comp);
+
+	/* step1: frequent source prefixes */
+	src_walk(&trie, flow, n, 0, 0);
+
+	/* step2: frequent destination prefixes under each of them */
+	for (i = 0; i < trie.nsnode; i++)
+		dst_walk(&trie, i, 0, trie.snode[i].nflow, 0);
+
+	/* step3: bottom-up extraction */
+	qsort(trie.node, trie.nnode, sizeof(struct trie_node), node_comp);
+	for (i = 0; i < trie.nnode; i++)
+		extract_node(&trie, &trie.node[i]);
+
+	trie_free(&trie);
+	return plist;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+static void
+drain_hash(struct odflow_hash *phash, struct odflow_list *plist)
+{
+	struct odflow *pflow;
+
+	while ((pflow = hash_pop(phash)) != NULL) {
+		plist->list[plist->size] = pflow;
+		pflow->list_index = plist->size++;
+	}
+}
+
+/* helper for qsort: destination address, then source address */
+static int
+dst_comp(const void *p0, const void *p1)
+{
+	struct odflow *pflow0, *pflow1;
+	int ret;
+
+	pflow0 = *(struct odflow **)p0;
+	pflow1 = *(struct odflow **)p1;
+
+	ret = memcmp(pflow0->spec.dst, pflow1->spec.dst, MAXLEN);
+	if (ret == 0)
+		ret = memcmp(pflow0->spec.src, pflow1->spec.src, MAXLEN);
+	return (ret);
+}
+
+/* helper for qsort: the order of the label tables */
+static int
+node_comp(const void *p0, const void *p1)
+{
+	const struct trie_node *pnode0 = p0, *pnode1 = p1;
+	uint32_t sum0, sum1;
+
+	sum0 = pnode0->srclen + pnode0->dstlen;
+	sum1 = pnode1->srclen + pnode1->dstlen;
+	if (sum0 != sum1)
+		return ((sum0 > sum1) ? -1 : 1);
+	if (pnode0->srclen != pnode1->srclen)
+		return ((pnode0->srclen > pnode1->srclen) ? -1 : 1);
+	return ((pnode0->seq < pnode1->seq) ? -1 : 1);
+}
+
+/* the bit next to the prefix of len bits */
+static int
+bit_test(uint8_t *addr, uint32_t len)
+{
+	return ((addr[len >> 3] >> (7 - (len & 7))) & 1);
+}
+
+/*
+ * a prefix pair can be (or include) a heavy hitter only when
+ * the total count of its flows exceeds the threshold.
+ */
+static int
+is_frequent(struct hhh_trie *ptrie, struct odflow **flow,
+    uint64_t lo, uint64_t hi, uint32_t srclen, uint32_t dstlen)
+{
+	struct odflow total;
+	uint64_t i;
+
+	total.byte   = 0;
+	total.packet = 0;
+	for (i = lo; i < hi; i++) {
+		if ((flow[i]->spec.srclen < srclen) ||
+		    (flow[i]->spec.dstlen < dstlen))
+			continue;
+		total.byte   += flow[i]->byte;
+		total.packet += flow[i]->packet;
+	}
+	return (check_thresh(ptrie->ctx, &total));
+}
+
+/*
+ * flow[] holds the flows under a source prefix of srclen bits, in the
+ * order of the destination address.  the children are made by a stable
+ * partition by the next bit, and the array is handed down as it is when
+ * every flow goes to the same child.
+ */
+static void
+src_walk(struct hhh_trie *ptrie, struct odflow **flow, uint64_t n,
+    uint32_t srclen, int shared)
+{
+	struct trie_snode *psnode;
+	struct odflow **child[2];
+	uint64_t nchild[2], i;
+	int bit;
+
+	if ((n == 0) || !is_frequent(ptrie, flow, 0, n, srclen, 0)) {
+		if (!shared)
+			free(flow);
+		return;
+	}
+
+	if (ptrie->nsnode == ptrie->max_snode) {
+		ptrie->max_snode = max(ptrie->max_snode * 2, TN_INITSIZE);
+		ptrie->snode = realloc(ptrie->snode,
+		    sizeof(struct trie_snode) * ptrie->max_snode);
+		if (ptrie->snode == NULL)
+			goto err;
+	}
+	psnode = &ptrie->snode[ptrie->nsnode++];
+	psnode->flow   = flow;
+	psnode->nflow  = n;
+	psnode->srclen = srclen;
+	psnode->shared = shared;
+
+	if (srclen == ptrie->maxlen)
+		return;
+
+	/* a flow of srclen bits has no child */
+	nchild[0] = nchild[1] = 0;
+	for (i = 0; i < n; i++) {
+		if (flow[i]->spec.srclen > srclen)
+			nchild[bit_test(flow[i]->spec.src, srclen)]++;
+	}
+	for (bit = 0; bit < 2; bit++) {
+		if (nchild[bit] == n) {
+			src_walk(ptrie, flow, n, srclen + 1, 1);
+			return;
+		}
+	}
+	for (bit = 0; bit < 2; bit++) {
+		child[bit] = NULL;
+		if ((nchild[bit] > 0) &&
+		    ((child[bit] = malloc(sizeof(struct odflow *) * nchild[bit])) == NULL))
+			goto err;
+		nchild[bit] = 0;
+	}
+	for (i = 0; i < n; i++) {
+		if (flow[i]->spec.srclen > srclen) {
+			bit = bit_test(flow[i]->spec.src, srclen);
+			child[bit][nchild[bit]++] = flow[i];
+		}
+	}
+	for (bit = 0; bit < 2; bit++)
+		src_walk(ptrie, child[bit], nchild[bit], srclen + 1, 0);
+	return;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+/*
+ * flows [lo, hi) of the snode share a destination prefix of dstlen bits.
+ * as they are ordered by the destination address, the flows with the
+ * next bit set follow the others.
+ */
+static void
+dst_walk(struct hhh_trie *ptrie, uint32_t snode, uint64_t lo, uint64_t hi,
+    uint32_t dstlen)
+{
+	struct trie_snode *psnode = &ptrie->snode[snode];
+	struct trie_node *pnode;
+	uint64_t mid;
+
+	if ((lo == hi) ||
+	    !is_frequent(ptrie, psnode->flow, lo, hi, psnode->srclen, dstlen))
+		return;
+
+	if (ptrie->nnode == ptrie->max_node) {
+		ptrie->max_node = max(ptrie->max_node * 2, TN_INITSIZE);
+		ptrie->node = realloc(ptrie->node,
+		    sizeof(struct trie_node) * ptrie->max_node);
+		if (ptrie->node == NULL) {
+			fprintf(stderr, "%s: malloc failed\n", __func__);
+			exit(1);
+		}
+	}
+	pnode = &ptrie->node[ptrie->nnode];
+	pnode->snode  = snode;
+	pnode->lo     = lo;
+	pnode->hi     = hi;
+	pnode->srclen = psnode->srclen;
+	pnode->dstlen = dstlen;
+	pnode->seq    = ptrie->nnode++;
+
+	if (dstlen == ptrie->maxlen)
+		return;
+
+	for (mid = lo; mid < hi; mid++) {
+		if (bit_test(psnode->flow[mid]->spec.dst, dstlen))
+			break;
+	}
+	dst_walk(ptrie, snode, lo, mid, dstlen + 1);
+	dst_walk(ptrie, snode, mid, hi, dstlen + 1);
+}
+
+/* the flows of an extracted node are reset by extract_hh() */
+static void
+extract_node(struct hhh_trie *ptrie, struct trie_node *pnode)
+{
+	struct trie_snode *psnode = &ptrie->snode[pnode->snode];
+	struct odflow *pagrflow, *pflow, *pfirst = NULL;
+	int label[2];
+	uint64_t i;
+
+	pagrflow = odflow_alloc();
+	if (pagrflow == NULL)
+		goto err;
+	for (i = pnode->lo; i < pnode->hi; i++) {
+		pflow = psnode->flow[i];
+		if ((pflow->spec.srclen < pnode->srclen) ||
+		    (pflow->spec.dstlen < pnode->dstlen))
+			continue;
+		if ((pflow->byte == 0) && (pflow->packet == 0))
+			continue;
+		if (pfirst == NULL)
+			pfirst = pflow;
+		pagrflow->byte   += pflow->byte;
+		pagrflow->packet += pflow->packet;
+	}
+	if ((pfirst == NULL) || !check_thresh(ptrie->ctx, pagrflow)) {
+		odflow_free(pagrflow);
+		return;
+	}
+
+	label[0] = pnode->srclen;
+	label[1] = pnode->dstlen;
+	pagrflow->spec = create_spec(&pfirst->spec, label, ptrie->bytesize);
+	pagrflow->af   = pfirst->af;
+	pagrflow->cache = list_alloc(CL_INITSIZE);
+	if (pagrflow->cache == NULL)
+		goto err;
+	for (i = pnode->lo; i < pnode->hi; i++) {
+		pflow = psnode->flow[i];
+		if ((pflow->spec.srclen < pnode->srclen) ||
+		    (pflow->spec.dstlen < pnode->dstlen))
+			continue;
+		if ((pflow->byte == 0) && (pflow->packet == 0))
+			continue;
+		list_add(pagrflow->cache, pflow);
+	}
+	extract_hh(ptrie->ctx, NULL, pagrflow);
+	return;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+static void
+trie_free(struct hhh_trie *ptrie)
+{
+	uint64_t i;
+
+	for (i = 0; i < ptrie->nsnode; i++) {
+		if (!ptrie->snode[i].shared)
+			free(ptrie->snode[i].flow);
+	}
+	free(ptrie->snode);
+	free(ptrie->node);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HHH_TRIE_H
+#define HHH_TRIE_H
+
+#include "../agurim_hhh.h"
+
+/*
+ * a source prefix with enough traffic to hold a heavy hitter.
+ * the flows under the prefix are ordered by the destination address,
+ * so that a destination prefix is a contiguous range of them.
+ */
+struct trie_snode {
+	struct odflow **flow;
+	uint64_t nflow;
+	uint32_t srclen;
+	int shared;		/* flow array belongs to the parent */
+};
+
+/* a (source, destination) prefix pair: flows [lo, hi) of the snode */
+struct trie_node {
+	uint32_t snode;
+	uint64_t lo, hi;
+	uint32_t srclen, dstlen;
+	uint64_t seq;		/* tie breaker in the order of the walk */
+};
+
+struct hhh_trie {
+	struct hhh_ctx *ctx;
+	uint32_t maxlen;	/* 32 for IPv4, 128 for IPv6 */
+	uint32_t bytesize;
+
+	struct trie_snode *snode;
+	uint64_t nsnode, max_snode;
+	struct trie_node *node;
+	uint64_t nnode, max_node;
+};
+
+struct odflow_list *
+trie_hhh(struct hhh_ctx *pctx, int af);
+
+#endif /* HHH_TRIE_H */
@@ -37,17 +37,17 @@
 #include "../agurim_param.h"
 #include "hhh_util.h"
 #include "hhh_task.h"
+#include "hhh_reduce.h"
 #include "odflow_hash.h"
 #include "odflow_list.h"
 
-#define CL_INITSIZE	64	/* initial array size */
-
-static int
-check_thresh(struct odflow* pflow);
-
+static uint64_t
+cover_list(struct hhh_task *ptask, struct odflow **covered);
+static uint64_t
+cover_index(struct hhh_task *ptask, struct odflow **covered);
 static void recount_hh(struct odflow *pagrflow);
 static void
-add_agrflow(struct hhh_task *ptask, struct odflow *pflow);
+add_agrflow(struct hhh_task *ptask, struct odflow **covered, uint64_t n);
 
 static int
 extract_now(struct hhh_task *ptask, struct odflow *pflow);
@@ -58,21 +58,20 @@ has_more_child_task(struct hhh_task *ptask);
 static void
 cache_update(struct odflow *pagrflow, struct odflow_spec *pspec);
 static void
-cache_flush(struct odflow *pagrflow);
+cache_flush(struct hhh_ctx *pctx, struct odflow *pagrflow);
 
 void
 refresh_hh(struct hhh_task *ptask)
 {
-	if (ptask->orig_flow == NULL) {
+	if (ptask->orig_flow == NULL || ptask->bitsize != 0) {
 		/* subflow aggregation has completed in child tasks. */
 		/* This parent task must be free without packet/byte counting */
+		/* NOTE: only the clone task (bitsize == 0) owns orig_flow */
 		return;
 	}
 	recount_hh(ptask->orig_flow);
-	if (check_thresh(ptask->orig_flow)){
-		hhh_submain(ptask->orig_flow);
-		cache_flush(ptask->orig_flow);
-		param_add_agrflow(ptask->orig_flow);
+	if (check_thresh(ptask->ctx, ptask->orig_flow)){
+		extract_hh(ptask->ctx, ptask, ptask->orig_flow);
 	} else {
 		if (ptask->bitsize == 0)
 			odflow_free(ptask->orig_flow);
@@ -84,13 +83,34 @@ refresh_hh(struct hhh_task *ptask)
 void
 create_hh(struct hhh_task *ptask)
 {
-	struct odflow *pflow;
-	uint64_t i;
+	struct odflow **covered;
+	uint64_t n;
 
 	if (ptask->list == NULL || ptask->end < 0){
 		printf("%s\n", __func__);
 		while(1);
 	}
+	/* the covered flows are in the first end flows of the list */
+	covered = malloc(sizeof(struct odflow *) * max(ptask->end, 1));
+	if (covered == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	if (ptask->index != NULL)
+		n = cover_index(ptask, covered);
+	else
+		n = cover_list(ptask, covered);
+	add_agrflow(ptask, covered, n);
+	free(covered);
+}
+
+/* the residual flows of the list covered by the label */
+static uint64_t
+cover_list(struct hhh_task *ptask, struct odflow **covered)
+{
+	struct odflow *pflow;
+	uint64_t i, n = 0;
+
 	for (i = 0; i < ptask->end; i++) {
 		pflow = ptask->list->list[i];
 		if (pflow == NULL)
@@ -98,38 +118,50 @@ create_hh(struct hhh_task *ptask)
 		if ((pflow->byte == 0) && (pflow->packet == 0))
 			continue;
 		if ((pflow->spec.srclen >= ptask->label[0]) && (pflow->spec.dstlen >= ptask->label[1])){
-			add_agrflow(ptask, pflow);
+			covered[n++] = pflow;
+		}
+	}
+	return n;
+}
+
+/* visit only the buckets of prefix length pairs covered by the label */
+static uint64_t
+cover_index(struct hhh_task *ptask, struct odflow **covered)
+{
+	struct list_index *pindex = ptask->index;
+	struct odflow *pflow;
+	uint64_t i, n = 0, slot;
+	uint32_t s, d;
+
+	for (s = ptask->label[0]; s <= pindex->maxlen; s++) {
+		for (d = ptask->label[1]; d <= pindex->maxlen; d++) {
+			slot = INDEX_SLOT(pindex, s, d);
+			for (i = pindex->start[slot];
+			    i < pindex->start[slot] + pindex->count[slot]; i++) {
+				pflow = ptask->list->list[i];
+				if ((pflow->byte == 0) && (pflow->packet == 0))
+					continue;
+				covered[n++] = pflow;
+			}
 		}
 	}
+	return n;
 }
 
 int
 find_hh(struct hhh_task *ptask)
 {
 	struct odflow *pflow;
-	struct odf_tailq *ptailq;
 	int more_task = 0;
-	uint64_t i;
 
-	if (ptask->hash->nrecord == 0)
-		goto end;
-	for (i = 0; i < NBUCKETS; i++) {
-		if (ptask->hash->nrecord <= 0)
-			break;
-		ptailq = &ptask->hash->tbl[i];
-		ptask->hash->nrecord -= ptailq->nrecord;
-                while ((pflow = TAILQ_FIRST(&ptailq->odfq_head)) != NULL) {
-			TAILQ_REMOVE(&ptailq->odfq_head, pflow, odf_chain);
-			ptailq->nrecord--;
-			if (!check_thresh(pflow)) {
-				odflow_free(pflow);
-				continue;
-			}
-			more_task += extract_now(ptask, pflow);
+	while ((pflow = hash_pop(ptask->hash)) != NULL) {
+		if (!check_thresh(ptask->ctx, pflow)) {
+			odflow_free(pflow);
+			continue;
 		}
+		more_task += extract_now(ptask, pflow);
 	}
 
-end:
 	if ((more_task == 0) && has_more_child_task(ptask)){
 		add_child_task(ptask, ptask->orig_flow);
 	}
@@ -137,32 +169,69 @@ end:
 	return ((more_task != 0) ? 0 : 1);
 }
 
-static int
-check_thresh(struct odflow* pflow)
+/*
+ * a label whose residual mass cannot pass the threshold extracts
+ * nothing, and its task is skipped.  the sort-and-reduce engine
+ * still makes the groups of a label that coarser labels derive from.
+ */
+int
+prune_hh(struct hhh_task *ptask)
+{
+	struct odflow hh;
+
+	if (ptask->index == NULL)
+		return 0;
+	index_residual(ptask->index, ptask->label, &hh);
+	if (check_thresh(ptask->ctx, &hh))
+		return 0;
+	if (query.engine != HASH_ENGINE)
+		return (reduce_skip(ptask));
+	return 1;
+}
+
+int
+check_thresh(struct hhh_ctx *pctx, struct odflow* pflow)
 {
 	int ret = 0;
 	if ((query.basis & BYTE) != 0){
-		if (inparam.mode == HHH_MAIN_MODE){
-			if (pflow->byte >= inparam.thresh_byte)
-				ret = 1;
-		} else {
-			if (pflow->byte >= inparam.thresh2_byte)
-				ret = 1;
-		}
+		if (pflow->byte >= pctx->thresh_byte)
+			ret = 1;
 	}
 	if ((query.basis & PACKET) != 0){
-		if (inparam.mode == HHH_MAIN_MODE){
-			if (pflow->packet >= inparam.thresh_packet)
-				ret = 1;
-		} else {
-			if (pflow->packet >= inparam.thresh2_packet)
-				ret = 1;
-		}
+		if (pflow->packet >= pctx->thresh_packet)
+			ret = 1;
 	}
 	return ret;
 }
 
 
+/*
+ * append the aggregated flow to the primary or the secondary flow list
+ * of the context (or to the task output in parallel HHH).
+ * subflows of the primary flows are aggregated after the main HHH.
+ */
+void
+extract_hh(struct hhh_ctx *pctx, struct hhh_task *ptask, struct odflow *pflow)
+{
+	cache_flush(pctx, pflow);
+	/* the member array of the task goes away with the task */
+	if ((pflow->cache != NULL) && (list_own(pflow->cache) != 0)) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	if ((ptask != NULL) && (ptask->output != NULL)) {
+		list_add(ptask->output, pflow);
+	}
+	else if (pctx->mode == HHH_MAIN_MODE) {
+		list_add(pctx->agrflow_list, pflow);
+	}
+	else {
+		if (pctx->subflow_list == NULL)
+			pctx->subflow_list = list_alloc(1);
+		list_add(pctx->subflow_list, pflow);
+	}
+}
+
 static void
 recount_hh(struct odflow *pagrflow)
 {
@@ -185,27 +254,64 @@ recount_hh(struct odflow *pagrflow)
 	}
 }
 
+/*
+ * aggregate the covered flows by the label.  the member flows of each
+ * aggregate are laid out in a range of the member array of the task,
+ * in the order of the covered flows, and its cache is a view of them.
+ */
 static void
-add_agrflow(struct hhh_task *ptask, struct odflow *pflow)
+add_agrflow(struct hhh_task *ptask, struct odflow **covered, uint64_t n)
 {
-	struct odflow *pagrflow;
+	struct odflow *pflow, *pagrflow;
+	struct odflow **owner, **member;
+	struct odflow_list *pcache;
 	struct odflow_spec spec;
-
-	spec = create_spec(&pflow->spec, ptask->label, ptask->bytesize);
-
-	pagrflow = hash_find(ptask->hash, &spec);
-	if (pflow != NULL) {
-		/* update values */
+	uint64_t i, off;
+
+	owner  = malloc(sizeof(struct odflow *) * max(n, 1));
+	member = malloc(sizeof(struct odflow *) * max(n, 1));
+	if (owner == NULL || member == NULL)
+		goto err;
+
+	/* count the members of each aggregate */
+	for (i = 0; i < n; i++) {
+		pflow = covered[i];
+		spec = create_spec(&pflow->spec, ptask->label, ptask->bytesize);
+		pagrflow = hash_find(ptask->hash, &spec);
+		if (pagrflow == NULL)
+			goto err;
 		pagrflow->byte   += pflow->byte;
 		pagrflow->packet += pflow->packet;
 		pagrflow->af      = pflow->af;
+		if (pagrflow->cache == NULL) {
+			pagrflow->cache = list_view(NULL, 0);
+			if (pagrflow->cache == NULL)
+				goto err;
+		}
+		pagrflow->cache->size++;
+		owner[i] = pagrflow;
+	}
 
-		/* FIXME allocate cache here because the count 
-		   of agrflows is included multiple odflows */
-		if (pagrflow->cache == NULL)
-			pagrflow->cache = list_alloc(CL_INITSIZE);
-		list_add(pagrflow->cache, pflow);
+	/* the range of each aggregate, in the order of its first member */
+	off = 0;
+	for (i = 0; i < n; i++) {
+		pcache = owner[i]->cache;
+		if (pcache->list == NULL) {
+			pcache->list = &member[off];
+			off += pcache->size;
+			pcache->size = 0;
+		}
 	}
+	for (i = 0; i < n; i++) {
+		pcache = owner[i]->cache;
+		pcache->list[pcache->size++] = covered[i];
+	}
+	free(owner);
+	ptask->member = member;
+	return;
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
 }
 
 static int
@@ -219,15 +325,7 @@ extract_now(struct hhh_task *ptask, struct odflow *pflow)
 		goto end;
 	}
 
-	if (inparam.mode == HHH_MAIN_MODE) {
-		hhh_submain(pflow);
-		cache_flush(pflow);
-		param_add_agrflow(pflow);
-	}
-	else {
-		cache_flush(pflow);
-		param_add_subflow(pflow);
-	}
+	extract_hh(ptask->ctx, ptask, pflow);
 end:
 	return subtask_flg;
 }
@@ -295,11 +393,19 @@ cache_update(struct odflow *pagrflow, struct odflow_spec *pspec)
 }
 
 static void
-cache_flush(struct odflow *pagrflow)
+cache_flush(struct hhh_ctx *pctx, struct odflow *pagrflow)
 {
+	struct list_index *pindex;
 	struct odflow *pflow;
-	uint64_t i, n;
+	uint64_t i, n, slot;
 
+	if (pagrflow->cache == NULL)
+		return;
+	pindex = NULL;
+	if (pagrflow->af == AF_INET)
+		pindex = pctx->index[0];
+	else if (pagrflow->af == AF_INET6)
+		pindex = pctx->index[1];
 	n = pagrflow->cache->size;
 	for (i = 0; i < n; i++){
 		pflow = pagrflow->cache->list[i]; 
@@ -308,6 +414,14 @@ cache_flush(struct odflow *pagrflow)
 		odflow_print(pflow);
 		printf("\n");
 #endif
+		if (pindex != NULL) {
+			/* child tasks of a label may run in parallel */
+			slot = INDEX_SLOT(pindex,
+			    min(pflow->spec.srclen, pindex->maxlen),
+			    min(pflow->spec.dstlen, pindex->maxlen));
+			__sync_fetch_and_sub(&pindex->byte[slot], pflow->byte);
+			__sync_fetch_and_sub(&pindex->packet[slot], pflow->packet);
+		}
 		pflow->byte = 0; 
 		pflow->packet = 0; 
 		//pagrflow->cache->list[i] = NULL;
@@ -35,5 +35,9 @@
 void refresh_hh(struct hhh_task *ptask);
 void create_hh(struct hhh_task *ptask);
 int find_hh(struct hhh_task *ptask);
+int prune_hh(struct hhh_task *ptask);
+int check_thresh(struct hhh_ctx *pctx, struct odflow *pflow);
+void
+extract_hh(struct hhh_ctx *pctx, struct hhh_task *ptask, struct odflow *pflow);
 
 #endif /* HHH_UTIL_H */
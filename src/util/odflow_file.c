@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "odflow_file.h"
+#include "odflow_list.h"
+
+/* a flow record; nsubflow subflow records follow */
+struct odflow_rec {
+	struct odflow_spec spec;
+	int32_t af;
+	uint32_t nsubflow;
+	uint64_t byte, packet;
+};
+
+/* write a flow and its subflows.  returns 0, or -1 on a write error */
+int
+odflow_write(FILE *fp, struct odflow *pflow)
+{
+	struct odflow_rec rec;
+	uint64_t i;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.spec     = pflow->spec;
+	rec.af       = pflow->af;
+	rec.byte     = pflow->byte;
+	rec.packet   = pflow->packet;
+	rec.nsubflow = (pflow->subflow != NULL) ? pflow->subflow->size : 0;
+	if (fwrite(&rec, sizeof(rec), 1, fp) != 1)
+		return (-1);
+	for (i = 0; i < rec.nsubflow; i++)
+		if (odflow_write(fp, pflow->subflow->list[i]) != 0)
+			return (-1);
+	return (0);
+}
+
+/* read a flow and its subflows.  returns NULL on a truncated record */
+struct odflow *
+odflow_read(FILE *fp)
+{
+	struct odflow_rec rec;
+	struct odflow *pflow, *psubflow;
+	uint32_t i;
+
+	if (fread(&rec, sizeof(rec), 1, fp) != 1)
+		return (NULL);
+	if ((pflow = odflow_alloc()) == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	pflow->spec   = rec.spec;
+	pflow->af     = rec.af;
+	pflow->byte   = rec.byte;
+	pflow->packet = rec.packet;
+	if (rec.nsubflow == 0)
+		return (pflow);
+	if ((pflow->subflow = list_alloc(rec.nsubflow)) == NULL) {
+		fprintf(stderr, "%s: malloc failed\n", __func__);
+		exit(1);
+	}
+	for (i = 0; i < rec.nsubflow; i++) {
+		if ((psubflow = odflow_read(fp)) == NULL) {
+			odflow_release(pflow);
+			return (NULL);
+		}
+		list_add(pflow->subflow, psubflow);
+	}
+	return (pflow);
+}
+
+/*
+ * write the number of the records, and the records of the hash.
+ * a bucket is written backwards, so that adding the records in the
+ * order of the file, at the head of the buckets (hash_add() or
+ * hash_find()), restores the order of the buckets.
+ */
+int
+hash_write(FILE *fp, struct odflow_hash *phash)
+{
+	struct odflow *pflow;
+	uint64_t nrecord = phash->nrecord;
+	uint32_t u;
+
+	if (fwrite(&nrecord, sizeof(uint64_t), 1, fp) != 1)
+		return (-1);
+	for (u = 0; u < phash->nused; u++) {
+		TAILQ_FOREACH_REVERSE(pflow,
+		    &phash->tbl[phash->used[u]].odfq_head, odfq, odf_chain)
+			if (odflow_write(fp, pflow) != 0)
+				return (-1);
+	}
+	return (0);
+}
+
+/* read the number of the records hash_write() has written */
+int
+hash_nrecord(FILE *fp, uint64_t *pnrecord)
+{
+	return (fread(pnrecord, sizeof(uint64_t), 1, fp) == 1 ? 0 : -1);
+}
@@ -63,6 +63,8 @@ struct odflow_hash *ip6_hash;
 struct odflow_hash *proto_hash;
 
 static uint32_t calc_slot(uint8_t *v1, uint8_t *v2);
+static void slot_use(struct odflow_hash *phash, uint32_t slot);
+static int slot_comp(const void *p0, const void *p1);
 
 struct odflow_hash *
 hash_alloc(void)
@@ -76,6 +78,10 @@ hash_alloc(void)
 
 	if ((phash->tbl = calloc(NBUCKETS, sizeof(struct odf_tailq))) == NULL)
 		goto err;
+	if ((phash->used = malloc(sizeof(uint32_t) * NBUCKETS)) == NULL) {
+		free(phash->tbl);
+		goto err;
+	}
 
 	for (i = 0; i < NBUCKETS; i++) {
 		TAILQ_INIT(&phash->tbl[i].odfq_head);
@@ -112,6 +118,7 @@ hash_find(struct odflow_hash *phash, struct odflow_spec *pspec)
 		if (pflow != NULL) {
 			memcpy(&pflow->spec, pspec, sizeof(struct odflow_spec));
 			TAILQ_INSERT_HEAD(&phash->tbl[slot].odfq_head, pflow, odf_chain);
+			slot_use(phash, slot);
 			phash->tbl[slot].nrecord++;
 			phash->nrecord++;
 		}
@@ -124,29 +131,77 @@ void
 hash_free(struct odflow_hash *phash)
 {
 	hash_reset(phash);
+	free(phash->used);
+	free(phash->tbl);
 	free(phash);
 }
 
 void
 hash_reset(struct odflow_hash *phash)
 {
-	int i;
+	struct odflow *pflow;
+
+	while ((pflow = hash_pop(phash)) != NULL)
+		odflow_free(pflow);
+
+	phash->byte = 0;
+	phash->packet = 0;
+}
+
+/*
+ * take a record out of the hash, in the order of the buckets.
+ * only the buckets having records are visited, so draining the hash
+ * costs the number of the records rather than NBUCKETS.
+ * returns NULL when the hash is empty.
+ * NOTE: no record may be added until the hash is drained.
+ */
+struct odflow *
+hash_pop(struct odflow_hash *phash)
+{
+	struct odf_tailq *ptailq;
 	struct odflow *pflow;
 
 	if (phash->nrecord == 0)
-		return;
+		return (NULL);
+	if (phash->next == 0 && phash->nused > 1)
+		qsort(phash->used, phash->nused, sizeof(uint32_t), slot_comp);
+	while ((pflow = TAILQ_FIRST(
+	    &phash->tbl[phash->used[phash->next]].odfq_head)) == NULL)
+		phash->next++;
+	ptailq = &phash->tbl[phash->used[phash->next]];
+	TAILQ_REMOVE(&ptailq->odfq_head, pflow, odf_chain);
+	ptailq->nrecord--;
+	if (--phash->nrecord == 0) {
+		/* the hash is empty, and the buckets are used again */
+		phash->nused = 0;
+		phash->next = 0;
+	}
+	return (pflow);
+}
 
-        for (i = 0; i < NBUCKETS; i++) {
-                while ((pflow = TAILQ_FIRST(&phash->tbl[i].odfq_head)) != NULL) {
-			TAILQ_REMOVE(&phash->tbl[i].odfq_head, pflow, odf_chain);
-			phash->tbl[i].nrecord--;
-			odflow_free(pflow);
+/*
+ * take a record out of the hash.  its bucket leaves used[] when it
+ * gets empty, so that the bucket can be used again.
+ * NOTE: not while the hash is drained by hash_pop().
+ */
+void
+hash_remove(struct odflow_hash *phash, struct odflow *pflow)
+{
+	struct odf_tailq *ptailq;
+	uint32_t slot, i;
+
+	slot = calc_slot(pflow->spec.src, pflow->spec.dst);
+	ptailq = &phash->tbl[slot];
+	TAILQ_REMOVE(&ptailq->odfq_head, pflow, odf_chain);
+	phash->nrecord--;
+	if (--ptailq->nrecord > 0)
+		return;
+	for (i = 0; i < phash->nused; i++) {
+		if (phash->used[i] == slot) {
+			phash->used[i] = phash->used[--phash->nused];
+			break;
 		}
 	}
-
-	phash->nrecord = 0;
-	phash->byte = 0;
-	phash->packet = 0;
 }
 
 uint32_t
@@ -168,6 +223,7 @@ hash_add(struct odflow_hash *phash, struct odflow *pflow)
 
 	if (dupflg != 1) {
 		TAILQ_INSERT_HEAD(&phash->tbl[slot].odfq_head, pflow, odf_chain);
+		slot_use(phash, slot);
 		phash->tbl[slot].nrecord++;
 		phash->nrecord++;
 	}
@@ -180,6 +236,23 @@ hash_add(struct odflow_hash *phash, struct odflow *pflow)
 	return dupflg;
 }
 
+/* the bucket has got the first record */
+static void
+slot_use(struct odflow_hash *phash, uint32_t slot)
+{
+	if (phash->tbl[slot].nrecord == 0)
+		phash->used[phash->nused++] = slot;
+}
+
+static int
+slot_comp(const void *p0, const void *p1)
+{
+	uint32_t s0 = *(const uint32_t *)p0;
+	uint32_t s1 = *(const uint32_t *)p1;
+
+	return ((s0 > s1) - (s0 < s1));
+}
+
 static uint32_t
 calc_slot(uint8_t *v1, uint8_t *v2)
 {
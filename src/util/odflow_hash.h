@@ -37,6 +37,8 @@
 struct odflow_hash *hash_alloc(void);
 void hash_free(struct odflow_hash *phash);
 void hash_reset(struct odflow_hash *phash);
+struct odflow *hash_pop(struct odflow_hash *phash);
+void hash_remove(struct odflow_hash *phash, struct odflow *pflow);
 
 /* NOTE: hash_find() allocates spec as a new entry if not found */
 struct odflow *
@@ -59,6 +59,44 @@ err:
 	goto end;
 }
 
+/*
+ * a list of the flows in list[0] .. list[size - 1] of an array owned
+ * by others, e.g., the member flows of an aggregate in the array of
+ * its task.  a view has no max_size, and must not be added to.
+ */
+struct odflow_list *
+list_view(struct odflow **list, uint64_t size)
+{
+	struct odflow_list *plist;
+
+	plist = malloc(sizeof(struct odflow_list));
+	if (plist == NULL)
+		return NULL;
+	plist->list = list;
+	plist->size = size;
+	plist->max_size = 0;
+	return plist;
+}
+
+/* copy the flows of a view into an array of the list's own */
+int
+list_own(struct odflow_list *plist)
+{
+	struct odflow **list;
+	uint64_t size;
+
+	if (plist->max_size != 0)
+		return 0;
+	size = (plist->size > 0) ? plist->size : 1;
+	list = malloc(sizeof(struct odflow *) * size);
+	if (list == NULL)
+		return -1;
+	memcpy(list, plist->list, sizeof(struct odflow *) * plist->size);
+	plist->list = list;
+	plist->max_size = size;
+	return 0;
+}
+
 void
 list_free(struct odflow_list *plist)
 {
@@ -68,7 +106,8 @@ list_free(struct odflow_list *plist)
 		plist->list[i] = NULL; 
 	}
 #endif
-	free(plist->list);
+	if (plist->max_size != 0)
+		free(plist->list);
 	plist->size = 0;
 	free(plist);
 }
@@ -78,6 +117,8 @@ list_add(struct odflow_list *plist, struct odflow* pflow)
 {
 	int ret = -1;
 
+	if ((plist->max_size == 0) && (list_own(plist) != 0))
+		goto end;
 	if (plist->size == plist->max_size) {
 		/* if full, double the size */
 		int newsize;
@@ -101,13 +142,16 @@ end:
 struct odflow*
 list_lookup(struct odflow_list *plist, struct odflow_spec *pspec)
 {
-	struct odflow *pflow = NULL;
+	struct odflow *pflow;
 	uint64_t i;
 	
+	if (plist == NULL)
+		return NULL;
 	for (i = 0; i < plist->size; i++) {
+		pflow = plist->list[i];
                 if (!memcmp(pspec, &(pflow->spec), sizeof(struct odflow_spec))) {
-			break;
+			return pflow;
 		}
 	}
-	return pflow;
+	return NULL;
 }
@@ -34,6 +34,8 @@
 
 #include "../agurim_odflow.h"
 struct odflow_list *list_alloc(int size);
+struct odflow_list *list_view(struct odflow **list, uint64_t size);
+int list_own(struct odflow_list *plist);
 void list_free(struct odflow_list *plist);
 
 int list_add(struct odflow_list *plist, struct odflow* pflow);
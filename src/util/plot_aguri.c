@@ -36,6 +36,7 @@
 
 #include "../agurim_param.h"
 #include "../agurim_odflow.h"
+#include "file_output.h"
 
 static void print_version(void);
 static void print_localtime(time_t time, char *key);
@@ -49,7 +50,7 @@ static void print_agrflow_list(void);
 void
 print_aguri(void)
 {
-	printf("\n");
+	out_char('\n');
 	print_version();
 	print_localtime(inparam.start_time, "StartTime");
 	print_localtime(inparam.end_time, "EndTime");
@@ -58,7 +59,7 @@ print_aguri(void)
 
 	/* STEP6: display flow aggregation threshold */
 	print_agurim_threshold();
-	printf("\n");
+	out_char('\n');
 
 	print_agrflow_list();
 }
@@ -67,21 +68,23 @@ print_aguri(void)
 static void
 print_version(void)
 {
-	printf("%%!AGURI-2.0\n");
+	out_str("%!AGURI-2.0\n");
 }
 
 /* display start and end timestamp */
 static void
 print_localtime(time_t time, char *key)
 {
-	char buf[128];
-
-	strftime(buf, sizeof(buf), "%a %b %d %T %Y",
-	    localtime(&time));
-	printf("%%%%%s: %s ", key, buf);
-	strftime(buf, sizeof(buf), "%Y/%m/%d %T",
-	    localtime(&time));
-	printf("(%s)\n", buf);
+	struct tm tm;
+
+	localtime_r(&time, &tm);
+	out_str("%%");
+	out_str(key);
+	out_str(": ");
+	out_date(&tm);
+	out_str(" (");
+	out_datetime(&tm);
+	out_str(")\n");
 }
 
 /* display average traffic rate in bps and pps */
@@ -90,6 +93,8 @@ print_traffic_rate(void)
 {
 	double avg_byte, avg_pkt;
 	double sec;
+	char *unit;
+
 	sec = (double)(inparam.end_time - inparam.start_time);
 	if (sec == 0.0) {
 		return;
@@ -97,18 +102,22 @@ print_traffic_rate(void)
 	avg_pkt = (double)inparam.total_packet / sec;
 	avg_byte = (double)inparam.total_byte * 8 / sec;
 
-	if (avg_byte > 1000000000.0)
-		printf("%%AvgRate: %.2fGbps %.2fpps\n",
-		    avg_byte/1000000000.0, avg_pkt);
-	else if (avg_byte > 1000000.0)
-		printf("%%AvgRate: %.2fMbps %.2fpps\n",
-		    avg_byte/1000000.0, avg_pkt);
-	else if (avg_byte > 1000.0)
-		printf("%%AvgRate: %.2fKbps %.2fpps\n",
-		    avg_byte/1000.0, avg_pkt);
-	else
-		printf("%%AvgRate: %.2fbps %.2fpps\n",
-		    avg_byte, avg_pkt);
+	if (avg_byte > 1000000000.0) {
+		avg_byte /= 1000000000.0;
+		unit = "Gbps ";
+	} else if (avg_byte > 1000000.0) {
+		avg_byte /= 1000000.0;
+		unit = "Mbps ";
+	} else if (avg_byte > 1000.0) {
+		avg_byte /= 1000.0;
+		unit = "Kbps ";
+	} else
+		unit = "bps ";
+	out_str("%AvgRate: ");
+	out_fixed2(avg_byte);
+	out_str(unit);
+	out_fixed2(avg_pkt);
+	out_str("pps\n");
 }
 
 /* display agggregation basis in Agurim */
@@ -116,18 +125,21 @@ static void
 print_agurim_basis(void)
 {
 	if (query.basis == BYTE)
-		printf("%% criteria: byte counter ");
+		out_str("% criteria: byte counter ");
 	else if (query.basis == PACKET)
-		printf("%% criteria: pkt counter ");
+		out_str("% criteria: pkt counter ");
 	else if (query.basis == COMBINATION)
-		printf("%% criteria: combination ");
+		out_str("% criteria: combination ");
 }
 
 static void
 print_agurim_threshold(void)
 {
-	printf("(%.f %% for addresses, %.f %% for protocol data)\n",
-	    (double)query.threshold, (double)query.threshold);
+	out_char('(');
+	out_i64(query.threshold);
+	out_str(" % for addresses, ");
+	out_i64(query.threshold);
+	out_str(" % for protocol data)\n");
 }
 
 static void
@@ -140,13 +152,21 @@ print_agrflow_list(void)
 	for (i = 0; i < inparam.agrflow_list->size; i++) {
 		pflow = inparam.agrflow_list->list[i];
 		/* STEP1: display the list index and primary odflow spec */
-		printf("[%2d] ", i);
+		out_str((i < 10) ? "[ " : "[");
+		out_i64(i);
+		out_str("] ");
 		odflow_print(pflow);
 
 		/* STEP2: display byte and packet count */
-		printf(": %" PRIu64 " (%.2f%%)\t%" PRIu64 " (%.2f%%)\n",
-		    pflow->byte, (double)pflow->byte / inparam.total_byte * 100,
-		    pflow->packet, (double)pflow->packet / inparam.total_packet * 100);
+		out_str(": ");
+		out_u64(pflow->byte);
+		out_str(" (");
+		out_fixed2((double)pflow->byte / inparam.total_byte * 100);
+		out_str("%)\t");
+		out_u64(pflow->packet);
+		out_str(" (");
+		out_fixed2((double)pflow->packet / inparam.total_packet * 100);
+		out_str("%)\n");
 		/* STEP3: display byte and packet count */
 		subflow_print(pflow); // TODO 
 	}
@@ -159,24 +179,25 @@ subflow_print(struct odflow *pflow)
 	struct odflow *psubflow;
 	uint64_t i;
 
-	printf("\t");
+	out_char('\t');
 	if ((plist == NULL) || (plist->size == 0)){
-		printf("[*:*:*] 100.00%% 100.00%%");
+		out_str("[*:*:*] 100.00% 100.00%");
 		goto end;
 	}
 	for (i = 0; i < plist->size; i++){
 		psubflow = plist->list[i];
-		printf("[");
+		out_char('[');
 		odflow_print(psubflow);
-		printf("]");
-		printf(" %.2f%% %.2f%% ",
-		    (double)psubflow->byte / pflow->byte * 100,
-		    (double)psubflow->packet / pflow->packet * 100);
+		out_str("] ");
+		out_fixed2((double)psubflow->byte / pflow->byte * 100);
+		out_str("% ");
+		out_fixed2((double)psubflow->packet / pflow->packet * 100);
+		out_str("% ");
 		odflow_free(psubflow); // FIXME 
 	}
 	list_free(plist);
 end:
-	printf("\n"); // FIXME
+	out_char('\n'); // FIXME
 }
 
 static void
@@ -36,6 +36,7 @@
 
 #include "../agurim_param.h"
 #include "../agurim_odflow.h"
+#include "file_output.h"
 
 static void print_localtime(time_t time, char *key);
 static void print_traffic_rate(void);
@@ -51,18 +52,18 @@ print_csv(void)
 {
 	uint64_t n;
 
-	printf("# ");
+	out_str("# ");
 	print_localtime(inparam.start_time, "StartTime");
-	printf("# ");
+	out_str("# ");
 	print_localtime(inparam.end_time, "EndTime");
-	printf("# ");
+	out_str("# ");
 	print_traffic_rate();
-	printf("# ");
+	out_str("# ");
 	print_agurim_basis();
 
 	/* STEP6: display flow aggregation threshold */
 	print_agurim_threshold();
-	printf("\n");
+	out_char('\n');
 
 	n = print_agrflow_list();
 	print_agrflow_data(n);
@@ -72,14 +73,16 @@ print_csv(void)
 static void
 print_localtime(time_t time, char *key)
 {
-	char buf[128];
-
-	strftime(buf, sizeof(buf), "%a %b %d %T %Y",
-	    localtime(&time));
-	printf("%%%%%s: %s ", key, buf);
-	strftime(buf, sizeof(buf), "%Y/%m/%d %T",
-	    localtime(&time));
-	printf("(%s)\n", buf);
+	struct tm tm;
+
+	localtime_r(&time, &tm);
+	out_str("%%");
+	out_str(key);
+	out_str(": ");
+	out_date(&tm);
+	out_str(" (");
+	out_datetime(&tm);
+	out_str(")\n");
 }
 
 /* display average traffic rate in bps and pps */
@@ -88,6 +91,8 @@ print_traffic_rate(void)
 {
 	double avg_byte, avg_pkt;
 	double sec;
+	char *unit;
+
 	sec = (double)(inparam.end_time - inparam.start_time);
 	if (sec == 0.0) {
 		return;
@@ -95,18 +100,22 @@ print_traffic_rate(void)
 	avg_pkt = (double)inparam.total_packet / sec;
 	avg_byte = (double)inparam.total_byte * 8 / sec;
 
-	if (avg_byte > 1000000000.0)
-		printf("%%AvgRate: %.2fGbps %.2fpps\n",
-		    avg_byte/1000000000.0, avg_pkt);
-	else if (avg_byte > 1000000.0)
-		printf("%%AvgRate: %.2fMbps %.2fpps\n",
-		    avg_byte/1000000.0, avg_pkt);
-	else if (avg_byte > 1000.0)
-		printf("%%AvgRate: %.2fKbps %.2fpps\n",
-		    avg_byte/1000.0, avg_pkt);
-	else
-		printf("%%AvgRate: %.2fbps %.2fpps\n",
-		    avg_byte, avg_pkt);
+	if (avg_byte > 1000000000.0) {
+		avg_byte /= 1000000000.0;
+		unit = "Gbps ";
+	} else if (avg_byte > 1000000.0) {
+		avg_byte /= 1000000.0;
+		unit = "Mbps ";
+	} else if (avg_byte > 1000.0) {
+		avg_byte /= 1000.0;
+		unit = "Kbps ";
+	} else
+		unit = "bps ";
+	out_str("%AvgRate: ");
+	out_fixed2(avg_byte);
+	out_str(unit);
+	out_fixed2(avg_pkt);
+	out_str("pps\n");
 }
 
 /* display agggregation basis in Agurim */
@@ -114,18 +123,21 @@ static void
 print_agurim_basis(void)
 {
 	if (query.basis == BYTE)
-		printf("criteria: byte counter ");
+		out_str("criteria: byte counter ");
 	else if (query.basis == PACKET)
-		printf("criteria: pkt counter ");
+		out_str("criteria: pkt counter ");
 	else if (query.basis == COMBINATION)
-		printf("criteria: combination ");
+		out_str("criteria: combination ");
 }
 
 static void
 print_agurim_threshold(void)
 {
-	printf("(%.f %% for addresses, %.f %% for protocol data)\n",
-	    (double)query.threshold, (double)query.threshold);
+	out_char('(');
+	out_i64(query.threshold);
+	out_str(" % for addresses, ");
+	out_i64(query.threshold);
+	out_str(" % for protocol data)\n");
 }
 
 static uint64_t
@@ -167,39 +179,42 @@ subflow_print(struct odflow *pflow)
 	if (plist == NULL)
 		goto end;
 	if (plist->size == 0){
-		printf("[*:*:*] 100.00%% 100.00%%");
+		out_str("[*:*:*] 100.00% 100.00%");
 	}
 	for (i = 0; i < plist->size; i++){
 		psubflow = plist->list[i];
 		odflow_print(psubflow);
-		printf(" %.2f%% %.2f%% ",
-		    (double)psubflow->byte / pflow->byte * 100,
-		    (double)psubflow->packet / pflow->packet * 100);
+		out_char(' ');
+		out_fixed2((double)psubflow->byte / pflow->byte * 100);
+		out_str("% ");
+		out_fixed2((double)psubflow->packet / pflow->packet * 100);
+		out_str("% ");
 		odflow_free(psubflow); // FIXME 
 	}
 	list_free(plist);
 end:
-	printf("\n"); // FIXME
+	out_char('\n'); // FIXME
 }
 
 static void
 print_agrflow_data(uint64_t n)
 {
-	uint64_t *plist;
+	uint64_t *pcnt;
 	uint64_t i, j, idx;
 	uint64_t m = inparam.plot_index;
 
 	for (i = 0; i < m; i++) {
-		printf("%ld, ", inparam.plots.time_list[i]);
-		printf("%ld, ", inparam.plots.total_list[i]);
+		out_i64(inparam.plots.time_list[i]);
+		out_str(", ");
+		out_i64(inparam.plots.total_list[i]);
+		out_str(", ");
 
+		/* a row is the counts of a slot */
+		pcnt = &PLOT_COUNT(&inparam.plots, i, 0);
 		for (j = 0; j < n; j++) {
 			idx = inparam.agrflow_list->list[j]->list_index;
-			plist = inparam.plots.cnt_list[idx];
-			if (j != n - 1)
- 				printf("%ld, ", plist[i]);
-			else	
- 				printf("%ld\n", plist[i]);
+			out_u64(pcnt[idx]);
+			out_str((j != n - 1) ? ", " : "\n");
 		}
 	}
 }
@@ -36,6 +36,7 @@
 
 #include "../agurim_param.h"
 #include "../agurim_odflow.h"
+#include "file_output.h"
 
 static void print_localtime(time_t time, char *key);
 static void print_traffic_rate(void);
@@ -51,7 +52,7 @@ print_json(void)
 {
 	uint64_t nagrflow;
 
-	printf("{\n");
+	out_str("{\n");
 	print_localtime(inparam.start_time, "StartTime");
 	print_localtime(inparam.end_time, "EndTime");
 	print_traffic_rate();
@@ -59,15 +60,18 @@ print_json(void)
 	print_agurim_threshold();
 	nagrflow = print_agrflow_list();
 	print_agrflow_data(nagrflow);
-	printf("}\n");
+	out_str("}\n");
 }
 
 /* display start and end timestamp */
 static void
 print_localtime(time_t time, char *key)
 {
-	printf("\"%s\": %d ", key, time);
-	printf(",\n");
+	out_char('"');
+	out_str(key);
+	out_str("\": ");
+	out_i64(time);
+	out_str(" ,\n");
 }
 
 /* display average traffic rate in bps and pps */
@@ -76,6 +80,8 @@ print_traffic_rate(void)
 {
 	double avg_byte, avg_pkt;
 	double sec;
+	char *unit;
+
 	sec = (double)(inparam.end_time - inparam.start_time);
 	if (sec == 0.0) {
 		return;
@@ -83,19 +89,22 @@ print_traffic_rate(void)
 	avg_pkt = (double)inparam.total_packet / sec;
 	avg_byte = (double)inparam.total_byte * 8 / sec;
 
-	if (avg_byte > 1000000000.0)
-		printf("\"AvgRate\": \"%.2fGbps %.2fpps\"",
-		    avg_byte/1000000000.0, avg_pkt);
-	else if (avg_byte > 1000000.0)
-		printf("\"AvgRate\": \"%.2fMbps %.2fpps\"",
-		    avg_byte/1000000.0, avg_pkt);
-	else if (avg_byte > 1000.0)
-		printf("\"AvgRate\": \"%.2fKbps %.2fpps\"",
-		    avg_byte/1000.0, avg_pkt);
-	else
-		printf("\"AvgRate\": \"%.2fbps %.2fpps\"",
-		    avg_byte, avg_pkt);
-	printf(",\n");
+	if (avg_byte > 1000000000.0) {
+		avg_byte /= 1000000000.0;
+		unit = "Gbps ";
+	} else if (avg_byte > 1000000.0) {
+		avg_byte /= 1000000.0;
+		unit = "Mbps ";
+	} else if (avg_byte > 1000.0) {
+		avg_byte /= 1000.0;
+		unit = "Kbps ";
+	} else
+		unit = "bps ";
+	out_str("\"AvgRate\": \"");
+	out_fixed2(avg_byte);
+	out_str(unit);
+	out_fixed2(avg_pkt);
+	out_str("pps\",\n");
 }
 
 /* display agggregation basis in Agurim */
@@ -103,17 +112,23 @@ static void
 print_agurim_basis(void)
 {
 	if (query.basis == BYTE)
-		printf("\"criteria\": \"byte\" ");
+		out_str("\"criteria\": \"byte\" ");
 	else if (query.basis == PACKET)
-		printf("\"criteria\": \"packet\" ");
+		out_str("\"criteria\": \"packet\" ");
 	else if (query.basis == COMBINATION)
-		printf("\"criteria\": \"combination\" ");
-	printf(",\n");
+		out_str("\"criteria\": \"combination\" ");
+	out_str(",\n");
 }
 
 static void
 print_agurim_threshold(void)
 {
+	/* the results of a sweep are told apart by the threshold */
+	if (inparam.nresult > 1) {
+		out_str("\"threshold\": ");
+		out_i64(query.threshold);
+		out_str(" ,\n");
+	}
 #if 0
 	printf("(%.f %% for addresses, %.f %% for protocol data)\n",
 	    (double)query.threshold, (double)query.threshold);
@@ -129,31 +144,49 @@ print_agrflow_list(void)
 	uint64_t n;
 
 	n = inparam.agrflow_list->size; 
-	printf("\"nflows\": %d", n+1);
+	out_str("\"nflows\": ");
+	out_u64(n + 1);
+	out_str(",\n");
 
-	printf("\"label\": [");
-	printf("\"TOTAL\", ");
+	out_str("\"label\": [");
+	out_str("\"TOTAL\", ");
 	for (i = 0; i < n; i++) {
 		pflow = inparam.agrflow_list->list[i];
-		printf("\"");
+		out_char('"');
 		/* STEP1: display the list index and primary odflow spec */
-		printf("[%2d] ", i);
+		out_str((i < 10) ? "[ " : "[");
+		out_i64(i);
+		out_str("] ");
 		odflow_print(pflow);
 
 		/* STEP2: display byte and packet count */
-		printf(": %" PRIu64 " (%.2f%%)\t%" PRIu64 " (%.2f%%)",
-		    pflow->byte, (double)pflow->byte / inparam.total_byte * 100,
-		    pflow->packet, (double)pflow->packet / inparam.total_packet * 100);
-		printf("\t");
+		out_str(": ");
+		out_u64(pflow->byte);
+		out_str(" (");
+		out_fixed2((double)pflow->byte / inparam.total_byte * 100);
+		out_str("%)\t");
+		out_u64(pflow->packet);
+		out_str(" (");
+		out_fixed2((double)pflow->packet / inparam.total_packet * 100);
+		out_str("%)");
+		/* error bounds of the estimated counts */
+		if (pflow->err != NULL) {
+			out_str("\t(+-");
+			out_u64(pflow->err->byte);
+			out_str(" +-");
+			out_u64(pflow->err->packet);
+			out_char(')');
+		}
+		out_char('\t');
 
 		/* STEP3: display byte and packet count */
 		subflow_print(pflow); // TODO 
 		if (i != n - 1)
-			printf("\", ");
+			out_str("\", ");
 		else
-			printf("\"");
+			out_char('"');
 	}
-	printf("],\n");
+	out_str("],\n");
 	return n;
 }
 
@@ -167,16 +200,17 @@ subflow_print(struct odflow *pflow)
 	if (plist == NULL)
 		goto end;
 	if (plist->size == 0){
-		printf("[*:*:*] 100.00%% 100.00%%");
+		out_str("[*:*:*] 100.00% 100.00%");
 	}
 	for (i = 0; i < plist->size; i++){
 		psubflow = plist->list[i];
-		printf("[");
+		out_char('[');
 		odflow_print(psubflow);
-		printf("]");
-		printf(" %.2f%% %.2f%% ",
-		    (double)psubflow->byte / pflow->byte * 100,
-		    (double)psubflow->packet / pflow->packet * 100);
+		out_str("] ");
+		out_fixed2((double)psubflow->byte / pflow->byte * 100);
+		out_str("% ");
+		out_fixed2((double)psubflow->packet / pflow->packet * 100);
+		out_str("% ");
 		odflow_free(psubflow); // FIXME 
 	}
 	list_free(plist);
@@ -187,38 +221,44 @@ end:
 static void
 print_agrflow_data(uint64_t n)
 {
-	uint64_t *plist;
+	uint64_t *pcnt;
 	uint64_t i, j, idx;
 	uint64_t m = inparam.plot_index;
 
-	printf("\"data\": [");
+	out_str("\"data\": [");
 
 	/* print the list of total count */
-	printf("[");
+	out_char('[');
 	for (j = 0; j < m; j++) {
-		printf("[%ld, ", inparam.plots.time_list[j]);
-		printf("%ld] ", inparam.plots.total_list[j]);
+		out_char('[');
+		out_i64(inparam.plots.time_list[j]);
+		out_str(", ");
+		out_i64(inparam.plots.total_list[j]);
+		out_str("] ");
 		if (j != m - 1)
-			printf(",");
+			out_char(',');
 	}
-	printf("],\n");
+	out_str("],\n");
 
-	/* print the list of agrflow count */
+	/* print the list of agrflow count, a column of the slots */
 	for (i = 0; i < n; i++) {
 		idx = inparam.agrflow_list->list[i]->list_index;
-		printf("[");
-		for (j = 0; j < m; j++) {
- 			printf("[%ld, ", inparam.plots.time_list[j]);
-			plist = inparam.plots.cnt_list[idx];
+		pcnt = &PLOT_COUNT(&inparam.plots, 0, idx);
+		out_char('[');
+		for (j = 0; j < m; j++, pcnt += inparam.plots.ncnt) {
+			out_char('[');
+			out_i64(inparam.plots.time_list[j]);
+			out_str(", ");
+			out_u64(*pcnt);
 			if (j != m - 1)
- 				printf("%ld], ", plist[j]);
-			else	
- 				printf("%ld]", plist[j]);
+				out_str("], ");
+			else
+				out_char(']');
 		}
 		if (i != n - 1)
-			printf("],\n");
+			out_str("],\n");
 		else
-			printf("]");
+			out_char(']');
 	}
-	printf("]\n");
+	out_str("]\n");
 }
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../agurim_param.h"
+#include "plot_trie.h"
+#include "odflow_list.h"
+
+/*
+ * the first aggregate in a list covering a flow, for the second pass
+ * of plot mode.  the source prefixes of the aggregates of an address
+ * family are kept in a path-compressed trie, and so are the destination
+ * prefixes.  a node has the bitmap of the aggregates having its prefix.
+ * a lookup walks each trie along the address of the flow, and the
+ * aggregates covering the flow are in the intersection of the bitmaps
+ * on the two paths.  its lowest bit is the first one in the list, as
+ * the linear scan of the list finds.  the intersection is made a word
+ * at a time, and the lookup ends at the first word having a bit.
+ */
+
+static int32_t
+node_insert(struct plot_trie *ptrie, int32_t *proot, uint8_t *addr,
+    uint32_t len);
+static int32_t node_alloc(struct plot_trie *ptrie, uint8_t *addr, uint32_t len);
+static uint32_t
+node_path(struct plot_trie *ptrie, int32_t n, uint8_t *addr, uint32_t len,
+    uint64_t **path);
+static uint32_t common_len(uint8_t *a, uint8_t *b, uint32_t len);
+static int af_slot(int af);
+
+#define PT_BIT(addr, i)	(((addr)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+static uint8_t allones[MAXLEN] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static inline uint64_t
+load64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v);
+}
+
+/* whether the address has the prefix of the node */
+static inline int
+node_match(struct ptrie_node *pnode, uint8_t *addr)
+{
+	if ((load64(addr) ^ pnode->key[0]) & pnode->mask[0])
+		return (0);
+	return (pnode->len <= 64 ||
+	    ((load64(addr + 8) ^ pnode->key[1]) & pnode->mask[1]) == 0);
+}
+
+struct plot_trie *
+ptrie_alloc(struct odflow_list *plist)
+{
+	struct plot_trie *ptrie;
+	struct ptrie_node *pnode;
+	struct odflow *pflow;
+	uint8_t *addr;
+	uint32_t i, len, nnode;
+	int32_t n, slot, dim;
+
+	/* an aggregate adds at most two nodes to each trie */
+	nnode = 4 * plist->size + 1;
+	if ((ptrie = calloc(1, sizeof(struct plot_trie))) == NULL)
+		goto err;
+	ptrie->nword = (plist->size + 63) / 64;
+	ptrie->node = malloc(sizeof(struct ptrie_node) * nnode);
+	ptrie->bitmap = calloc(2 * plist->size * ptrie->nword + 1,
+	    sizeof(uint64_t));
+	if (ptrie->node == NULL || ptrie->bitmap == NULL)
+		goto err;
+	for (slot = 0; slot < PT_NAF; slot++)
+		ptrie->root[slot][0] = ptrie->root[slot][1] = -1;
+
+	for (i = 0; i < plist->size; i++) {
+		pflow = plist->list[i];
+		if ((slot = af_slot(pflow->af)) < 0)
+			continue;
+		for (dim = 0; dim < 2; dim++) {
+			addr = (dim == 0) ? pflow->spec.src : pflow->spec.dst;
+			len = (dim == 0) ? pflow->spec.srclen : pflow->spec.dstlen;
+			n = node_insert(ptrie, &ptrie->root[slot][dim], addr, len);
+			pnode = &ptrie->node[n];
+			if (pnode->bits < 0)
+				pnode->bits = ptrie->nword * ptrie->nbitmap++;
+			ptrie->bitmap[pnode->bits + i / 64] |= 1ULL << (i % 64);
+		}
+	}
+	return (ptrie);
+err:
+	fprintf(stderr, "%s: malloc failed\n", __func__);
+	exit(1);
+}
+
+void
+ptrie_free(struct plot_trie *ptrie)
+{
+	if (ptrie == NULL)
+		return;
+	free(ptrie->bitmap);
+	free(ptrie->node);
+	free(ptrie);
+}
+
+/* returns the index of the first aggregate covering the flow, or -1 */
+int
+ptrie_find(struct plot_trie *ptrie, struct odflow *pflow)
+{
+	uint64_t *spath[MAXLEN * 8 + 1], *dpath[MAXLEN * 8 + 1];
+	uint64_t sbits, dbits, bits;
+	uint32_t ns, nd, i, w;
+	int slot;
+
+	if ((slot = af_slot(pflow->af)) < 0)
+		return (-1);
+	ns = node_path(ptrie, ptrie->root[slot][0], pflow->spec.src,
+	    pflow->spec.srclen, spath);
+	if (ns == 0)
+		return (-1);
+	nd = node_path(ptrie, ptrie->root[slot][1], pflow->spec.dst,
+	    pflow->spec.dstlen, dpath);
+	if (nd == 0)
+		return (-1);
+
+	for (w = 0; w < ptrie->nword; w++) {
+		sbits = dbits = 0;
+		for (i = 0; i < ns; i++)
+			sbits |= spath[i][w];
+		for (i = 0; i < nd; i++)
+			dbits |= dpath[i][w];
+		if ((bits = sbits & dbits) != 0)
+			return (w * 64 + __builtin_ctzll(bits));
+	}
+	return (-1);
+}
+
+/* the bitmaps of the nodes covering the address, from the root */
+static uint32_t
+node_path(struct plot_trie *ptrie, int32_t n, uint8_t *addr, uint32_t len,
+    uint64_t **path)
+{
+	struct ptrie_node *pnode;
+	uint32_t npath = 0;
+
+	while (n >= 0) {
+		pnode = &ptrie->node[n];
+		if (pnode->len > len || !node_match(pnode, addr))
+			break;
+		if (pnode->bits >= 0)
+			path[npath++] = &ptrie->bitmap[pnode->bits];
+		if (pnode->len == len)
+			break;
+		n = pnode->child[PT_BIT(addr, pnode->len)];
+	}
+	return (npath);
+}
+
+/*
+ * the node of the prefix in the trie at *proot, created if missing.
+ * a node is split by a branching node where the prefix leaves it.
+ * the nodes have been allocated in advance, and do not move.
+ */
+static int32_t
+node_insert(struct plot_trie *ptrie, int32_t *proot, uint8_t *addr,
+    uint32_t len)
+{
+	struct ptrie_node *pnode, *pbranch;
+	int32_t *plink = proot;
+	int32_t n, b, leaf;
+	uint32_t c;
+
+	for (;;) {
+		if ((n = *plink) < 0) {
+			*plink = node_alloc(ptrie, addr, len);
+			return (*plink);
+		}
+		pnode = &ptrie->node[n];
+		c = common_len((uint8_t *)pnode->key, addr, min(pnode->len, len));
+		if (c == pnode->len) {
+			if (c == len)
+				return (n);
+			plink = &pnode->child[PT_BIT(addr, c)];
+			continue;
+		}
+		/* the prefixes part at bit c, below the node */
+		b = node_alloc(ptrie, addr, c);
+		pbranch = &ptrie->node[b];
+		pbranch->child[PT_BIT((uint8_t *)pnode->key, c)] = n;
+		*plink = b;
+		if (c == len)
+			return (b);
+		leaf = node_alloc(ptrie, addr, len);
+		pbranch->child[PT_BIT(addr, c)] = leaf;
+		return (leaf);
+	}
+}
+
+static int32_t
+node_alloc(struct plot_trie *ptrie, uint8_t *addr, uint32_t len)
+{
+	struct ptrie_node *pnode;
+	uint8_t key[MAXLEN], mask[MAXLEN];
+
+	pnode = &ptrie->node[ptrie->nnode];
+	prefix_set(addr, len, key, MAXLEN);
+	prefix_set(allones, len, mask, MAXLEN);
+	memcpy(pnode->key, key, MAXLEN);
+	memcpy(pnode->mask, mask, MAXLEN);
+	pnode->len = len;
+	pnode->child[0] = pnode->child[1] = -1;
+	pnode->bits = -1;
+	return (ptrie->nnode++);
+}
+
+/* the length of the common prefix of a and b, up to len bits */
+static uint32_t
+common_len(uint8_t *a, uint8_t *b, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i += 8)
+		if (a[i >> 3] != b[i >> 3])
+			break;
+	for (; i < len; i++)
+		if (PT_BIT(a, i) != PT_BIT(b, i))
+			break;
+	return (i < len ? i : len);
+}
+
+static int
+af_slot(int af)
+{
+	switch (af) {
+	case AF_INET:
+		return (0);
+	case AF_INET6:
+		return (1);
+	case AF_LOCAL:
+		return (2);
+	}
+	return (-1);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PLOT_TRIE_H
+#define PLOT_TRIE_H
+
+#include "../agurim_odflow.h"
+
+#define PT_NAF		3	/* AF_INET, AF_INET6 and AF_LOCAL */
+#define PT_MINFLOWS	128	/* shorter lists are scanned linearly */
+
+/*
+ * a node of a path-compressed binary prefix trie of a dimension, the
+ * source or the destination.  bits is the offset of the bitmap of the
+ * aggregates having the prefix of the node in the dimension, or -1 for
+ * a node only branching.
+ */
+struct ptrie_node {
+	uint64_t key[2];	/* the prefix, in the byte order of a spec */
+	uint64_t mask[2];
+	uint32_t len;
+	int32_t child[2];
+	int32_t bits;
+};
+
+/*
+ * the aggregates of a list, compiled into a source trie and a
+ * destination trie for each address family.  a bitmap has a bit for
+ * each aggregate, in the order of the list.
+ */
+struct plot_trie {
+	int32_t root[PT_NAF][2];
+	struct ptrie_node *node;
+	uint32_t nnode;
+	uint64_t *bitmap;
+	uint32_t nbitmap;
+	uint32_t nword;		/* words of a bitmap */
+};
+
+struct plot_trie *ptrie_alloc(struct odflow_list *plist);
+void ptrie_free(struct plot_trie *ptrie);
+int ptrie_find(struct plot_trie *ptrie, struct odflow *pflow);
+
+#endif /* PLOT_TRIE_H */
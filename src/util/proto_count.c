@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "proto_count.h"
+#include "hhh_util.h"
+#include "odflow_hash.h"
+#include "odflow_list.h"
+#include "../agurim_param.h"
+
+#define CL_INITSIZE	64	/* initial array size */
+
+/*
+ * protocol labels: {proto:sport:dport}, {proto:sport:*}, {proto:*:dport},
+ * {proto:*:*} and {*:*:*}.
+ * a protocol spec has only 8-bit proto and 16-bit ports, so that
+ * each label is counted in direct-indexed arrays instead of the hash.
+ */
+static int proto_labels[5][2] = {
+  {24,24},{24,8},{8,24},{8,8},{0,0}
+};
+
+static void drain_hash(struct odflow_hash *phash, struct odflow_list *plist);
+static int is_target(struct odflow *pflow, int *label);
+static struct proto_cell *
+get_cell(struct proto_count *pcount, struct odflow *pflow, int *label);
+static void
+add_member(struct odflow *pagrflow, struct odflow *pflow, int *label);
+static void
+count_label(struct hhh_ctx *pctx, struct odflow_list *plist, int *label);
+
+/*
+ * HHH for protocol specs.
+ * flows in phash are moved to the returned list, which is freed by the
+ * caller in the same way as the list made by taskq_create().
+ */
+struct odflow_list *
+proto_hhh(struct hhh_ctx *pctx, struct odflow_hash *phash)
+{
+	struct odflow_list *plist;
+	uint32_t i, len;
+
+	if (phash->nrecord == 0)
+		return NULL;
+
+	plist = list_alloc(phash->nrecord);
+	drain_hash(phash, plist);
+
+	len = sizeof(proto_labels)/sizeof(int)/2;
+	for (i = 0; i < len; i++)
+		count_label(pctx, plist, proto_labels[i]);
+
+	return plist;
+}
+
+uint32_t
+pcount_labels(int (**plabels)[2])
+{
+	*plabels = proto_labels;
+	return (sizeof(proto_labels)/sizeof(int)/2);
+}
+
+/* the second-level port tables are allocated on demand */
+struct proto_count *
+pcount_alloc(void)
+{
+	return (calloc(1, sizeof(struct proto_count)));
+}
+
+static void
+drain_hash(struct odflow_hash *phash, struct odflow_list *plist)
+{
+	struct odflow *pflow;
+
+	while ((pflow = hash_pop(phash)) != NULL) {
+		plist->list[plist->size] = pflow;
+		pflow->list_index = plist->size++;
+	}
+}
+
+static int
+is_target(struct odflow *pflow, int *label)
+{
+	if ((pflow->byte == 0) && (pflow->packet == 0))
+		return 0;
+	return ((pflow->spec.srclen >= label[0]) && (pflow->spec.dstlen >= label[1]));
+}
+
+/* returns NULL for {proto:sport:dport} as each flow is its own aggregate */
+static struct proto_cell *
+get_cell(struct proto_count *pcount, struct odflow *pflow, int *label)
+{
+	struct proto_cell **ptbl;
+	uint8_t *port;
+
+	if (label[0] >= 24 && label[1] >= 24)
+		return NULL;
+
+	if (label[0] >= 24) {
+		ptbl = &pcount->sport[pflow->spec.src[0]];
+		port = pflow->spec.src;
+	} else if (label[1] >= 24) {
+		ptbl = &pcount->dport[pflow->spec.dst[0]];
+		port = pflow->spec.dst;
+	} else if (label[0] > 0 || label[1] > 0) {
+		return (&pcount->proto[pflow->spec.src[0]]);
+	} else {
+		return (&pcount->any);
+	}
+
+	if (*ptbl == NULL) {
+		*ptbl = calloc(PC_NPORT, sizeof(struct proto_cell));
+		if (*ptbl == NULL) {
+			fprintf(stderr, "%s: calloc failed\n", __func__);
+			exit(1);
+		}
+	}
+	return (&(*ptbl)[(port[1] << 8) + port[2]]);
+}
+
+static void
+add_member(struct odflow *pagrflow, struct odflow *pflow, int *label)
+{
+	if (pagrflow->cache == NULL) {
+		pagrflow->spec = create_spec(&pflow->spec, label, 3);
+		pagrflow->af = pflow->af;
+		pagrflow->cache = list_alloc(CL_INITSIZE);
+	}
+	pagrflow->byte   += pflow->byte;
+	pagrflow->packet += pflow->packet;
+	list_add(pagrflow->cache, pflow);
+}
+
+/*
+ * aggregate flows for a label in 3 passes over the flow list:
+ * (1) roll up the counters, (2) collect the members of the cells
+ * exceeding the threshold, and (3) reset the touched cells.
+ * then, the aggregated flows are extracted in the order of appearance.
+ */
+static void
+count_label(struct hhh_ctx *pctx, struct odflow_list *plist, int *label)
+{
+	struct odflow_list *phh;
+	struct proto_cell *pcell, cell;
+	struct odflow *pflow, hh;
+	uint64_t i;
+
+	phh = list_alloc(CL_INITSIZE);
+
+	for (i = 0; i < plist->size; i++) {
+		pflow = plist->list[i];
+		if (!is_target(pflow, label))
+			continue;
+		if ((pcell = get_cell(pctx->pcount, pflow, label)) == NULL)
+			continue;
+		pcell->byte   += pflow->byte;
+		pcell->packet += pflow->packet;
+	}
+
+	for (i = 0; i < plist->size; i++) {
+		pflow = plist->list[i];
+		if (!is_target(pflow, label))
+			continue;
+		if ((pcell = get_cell(pctx->pcount, pflow, label)) == NULL) {
+			memset(&cell, 0, sizeof(cell));
+			cell.byte   = pflow->byte;
+			cell.packet = pflow->packet;
+			pcell = &cell;
+		}
+		if (pcell->agrflow == NULL) {
+			hh.byte   = pcell->byte;
+			hh.packet = pcell->packet;
+			if (!check_thresh(pctx, &hh))
+				continue;
+			pcell->agrflow = odflow_alloc();
+			list_add(phh, pcell->agrflow);
+		}
+		add_member(pcell->agrflow, pflow, label);
+	}
+
+	for (i = 0; i < plist->size; i++) {
+		pflow = plist->list[i];
+		if ((pcell = get_cell(pctx->pcount, pflow, label)) != NULL)
+			memset(pcell, 0, sizeof(struct proto_cell));
+	}
+
+	for (i = 0; i < phh->size; i++)
+		extract_hh(pctx, NULL, phh->list[i]);
+	list_free(phh);
+}
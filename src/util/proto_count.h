@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2012-2015 WIDE Project.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *    - Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    - Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PROTO_COUNT_H
+#define PROTO_COUNT_H
+
+#include "../agurim_odflow.h"
+#include "../agurim_hhh.h"
+
+#define PC_NPROTO	256	/* 8-bit protocol number */
+#define PC_NPORT	65536	/* 16-bit port number */
+
+/* a counter cell directly indexed by (proto, port) */
+struct proto_cell {
+	uint64_t byte;
+	uint64_t packet;
+	struct odflow *agrflow;	/* set when the cell exceeds the threshold */
+};
+
+struct proto_count {
+	struct proto_cell *sport[PC_NPROTO];	/* allocated on demand */
+	struct proto_cell *dport[PC_NPROTO];	/* allocated on demand */
+	struct proto_cell proto[PC_NPROTO];
+	struct proto_cell any;
+};
+
+struct odflow_list *
+proto_hhh(struct hhh_ctx *pctx, struct odflow_hash *phash);
+struct proto_count *pcount_alloc(void);
+uint32_t pcount_labels(int (**plabels)[2]);
+
+#endif /* PROTO_COUNT_H */